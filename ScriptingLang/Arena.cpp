@@ -0,0 +1,26 @@
+#include "pch.hpp"
+#include "Arena.hpp"
+
+using namespace Plang;
+
+void* Arena::AllocateBlock(size_t Size, size_t Alignment)
+{
+    auto size = Size + Alignment; //blocks are only guaranteed to be aligned to alignof(std::max_align_t)
+
+    //large allocations get their own block so that the current block is not wasted
+    if (size > blockSize / 4 && next != nullptr)
+    {
+        blocks.emplace_back(new char[size]);
+        reserved += size;
+        used += Size;
+        auto block = blocks.back().get();
+        return block + ((Alignment - ((uintptr_t)block & (Alignment - 1))) & (Alignment - 1));
+    }
+
+    size = std::max(size, blockSize);
+    blocks.emplace_back(new char[size]);
+    reserved += size;
+    next = blocks.back().get();
+    limit = next + size;
+    return Allocate(Size, Alignment);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "pch.hpp"
+
+namespace Plang
+{
+    //A view of a contiguous run of items owned by something else (e.g. an arena)
+    template <typename T>
+    class Span
+    {
+    public:
+        Span() = default;
+        Span(T* items, size_t count) : items(items), count(count) { }
+
+        inline size_t size() const { return count; }
+        inline bool empty() const { return count == 0; }
+
+        inline T* begin() const { return items; }
+        inline T* end() const { return items + count; }
+        inline std::reverse_iterator<const T*> crbegin() const { return std::reverse_iterator<const T*>(items + count); }
+        inline std::reverse_iterator<const T*> crend() const { return std::reverse_iterator<const T*>(items); }
+
+        inline T& operator [](size_t index) const { return items[index]; }
+        inline T& at(size_t index) const
+        {
+            if (index >= count)
+                throw std::out_of_range("Span index out of range");
+            return items[index];
+        }
+
+        inline T& front() const { return items[0]; }
+        inline T& back() const { return items[count - 1]; }
+
+    protected:
+        T* items = nullptr;
+        size_t count = 0;
+    };
+
+    //A bump allocator. Allocations are only released when the arena is destroyed, so objects allocated from it are never destructed
+    class Arena
+    {
+    public:
+        static constexpr size_t DefaultBlockSize = 64 * 1024;
+
+        Arena(size_t BlockSize = DefaultBlockSize) : blockSize(BlockSize) { }
+
+        Arena(const Arena&) = delete;
+        Arena& operator = (const Arena&) = delete;
+        Arena(Arena&&) = default;
+        Arena& operator = (Arena&&) = default;
+
+        inline void* Allocate(size_t Size, size_t Alignment)
+        {
+            auto padding = (Alignment - ((uintptr_t)next & (Alignment - 1))) & (Alignment - 1);
+            if (next == nullptr || padding + Size > (size_t)(limit - next))
+                return AllocateBlock(Size, Alignment);
+
+            auto allocation = next + padding;
+            next = allocation + Size;
+            used += Size;
+            return allocation;
+        }
+
+        template <typename T>
+        Span<T> Allocate(size_t Count)
+        {
+            static_assert(std::is_trivially_destructible<T>::value, "Arena allocated types are never destructed");
+            auto items = static_cast<T*>(Allocate(sizeof(T) * Count, alignof(T)));
+            std::uninitialized_value_construct_n(items, Count);
+            return Span<T>(items, Count);
+        }
+
+        template <typename T>
+        Span<T> Copy(const T* Items, size_t Count)
+        {
+            static_assert(std::is_trivially_destructible<T>::value, "Arena allocated types are never destructed");
+            auto items = static_cast<T*>(Allocate(sizeof(T) * Count, alignof(T)));
+            std::uninitialized_copy_n(Items, Count, items);
+            return Span<T>(items, Count);
+        }
+
+        template <typename T>
+        inline Span<T> Copy(std::initializer_list<T> Items) { return Copy(Items.begin(), Items.size()); }
+
+        std::string_view Copy(std::string_view String)
+        {
+            auto chars = static_cast<char*>(Allocate(String.length(), 1));
+            std::copy(String.begin(), String.end(), chars);
+            return std::string_view(chars, String.length());
+        }
+
+        inline size_t Used() const { return used; } //the number of bytes allocated
+        inline size_t Reserved() const { return reserved; } //the number of bytes in the arena's blocks
+
+    protected:
+        void* AllocateBlock(size_t Size, size_t Alignment);
+
+        std::vector<std::unique_ptr<char[]>> blocks;
+        char* next = nullptr;
+        char* limit = nullptr;
+        size_t blockSize;
+        size_t used = 0;
+        size_t reserved = 0;
+    };
+};
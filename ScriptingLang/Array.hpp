@@ -19,7 +19,7 @@ public:
 	Array(T Array[]) : length(sizeof(Array) / sizeof(T)), indices(Array) { }
 
 	Array(const Array& Array) : length(Array.length), indices(new T[Array.length]) { std::copy(Array.indices, Array.indices + Array.length, indices); }
-	Array(Array&& Array) : length(Array.length), indices(std::move(Array.indices)) { Array.indices = nullptr; Array.length = 0; }
+	Array(Array&& Array) noexcept : length(Array.length), indices(std::move(Array.indices)) { Array.indices = nullptr; Array.length = 0; }
 
 	~Array() { if (indices != nullptr) delete[] indices; length = 0; }
 
@@ -40,7 +40,7 @@ public:
 		}
 		return *this;
 	}
-	inline Array& operator = (Array&& Array)
+	inline Array& operator = (Array&& Array) noexcept
 	{
 		if (Array.indices != indices)
 		{
@@ -0,0 +1,101 @@
+//Allocation heavy scripts, run with only reference counting (the collector disabled) and with the collector.
+//Each run is in its own process so that its peak memory use can be measured (POSIX only)
+#include "pch.hpp"
+#include "Lexer.hpp"
+#include "Parser.hpp"
+#include "Construct.hpp"
+#include "Heap.hpp"
+#include <chrono>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace Plang;
+
+struct Workload
+{
+    std::string name;
+    std::string source;
+    size_t retained; //constructs kept alive in the scope while the script runs
+};
+
+static void Run(const Workload& Workload, bool Collect, size_t Evaluations)
+{
+    Heap::threshold = (Collect ? 1000 : 0);
+
+    Lexer lexer("bench", Workload.source);
+    Parser parser;
+    if (!parser.Parse(lexer))
+    {
+        std::cout << Workload.name << ": parse error\n";
+        return;
+    }
+
+    auto scope(Heap::New<Construct>());
+    auto a(Heap::New<Construct>());
+    a->Set("b", 10);
+    scope->Set("a", a);
+    scope->Set("x", 2.5);
+    //a construct referencing itself, through a property and a list
+    scope->Set("cycle", Heap::New<Function>([](Construct&)
+    {
+        auto construct(Heap::New<Construct>());
+        auto list(Heap::New<List>());
+        list->Add(construct);
+        construct->Set("self", construct);
+        construct->Set("list", list);
+        return Value(construct);
+    }));
+
+    auto retained(Heap::New<List>());
+    for (size_t i = 0; i < Workload.retained; ++i)
+    {
+        auto item(Heap::New<Construct>());
+        item->Set("i", (TInt)i);
+        retained->Add(item);
+    }
+    scope->Set("retained", retained);
+
+    Script script(parser.root, parser.arena);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < Evaluations; ++i)
+        script.Evaluate(scope);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    auto stats = Heap::Stats();
+    std::cout << std::setw(10) << Workload.name << (Collect ? "  collected    " : "  refcounting  ")
+              << std::setw(10) << (size_t)(Evaluations / elapsed.count()) << " evaluations/s  "
+              << std::setw(8) << std::fixed << std::setprecision(1) << (usage.ru_maxrss / 1024.0) << " MB peak  "
+              << std::setw(8) << stats.live << " live  "
+              << std::setw(6) << stats.collections << " collections\n";
+}
+
+int main(int ac, const char* av[])
+{
+    size_t evaluations = (ac > 1 ? (size_t)atol(av[1]) : 100000);
+
+    const Workload workloads[] =
+    {
+        { "lists", "[[1, 2], [x, [a.b, \"s\"]], [3, [4, [5]]], \"t\"];", 0 },
+        { "cycles", "[cycle(1), cycle(2), [cycle(3)]];", 0 },
+        { "retained", "[cycle(1), cycle(2), [cycle(3)]];", 200000 },
+    };
+    for (auto& workload : workloads)
+    {
+        for (auto collect : { false, true })
+        {
+            std::cout.flush();
+            auto child = fork();
+            if (child == 0)
+            {
+                Run(workload, collect, evaluations);
+                std::cout.flush();
+                _exit(0);
+            }
+            waitpid(child, nullptr, 0);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,146 @@
+//Interpreter throughput: evaluates a few scripts repeatedly with the tree walker and the bytecode VM.
+//Build with and without PLANG_SWITCH_DISPATCH (make benchmarks) to compare dispatch modes.
+//Built with PLANG_PROFILE_OPCODES, this also prints the most common sequences of operations (used to choose the superinstructions)
+#include "pch.hpp"
+#include "Lexer.hpp"
+#include "Parser.hpp"
+#include "Construct.hpp"
+#include "Bytecode.hpp"
+#include <chrono>
+
+using namespace Plang;
+
+//the number of operations a compiled script runs (scripts have no branches, so every operation runs once)
+static size_t CountOperations(const Bytecode& Code)
+{
+    auto count = Code.operations.size();
+    for (auto& script : Code.scripts)
+    {
+        if (script->IsCompiled())
+            count += CountOperations(*script);
+    }
+    return count;
+}
+
+static size_t CountInstructions(const Instruction& Root)
+{
+    size_t count = 0;
+    std::vector<const Instruction*> stack { &Root };
+    while (!stack.empty())
+    {
+        auto instruction = stack.back();
+        stack.pop_back();
+        ++count;
+        if (auto list = std::get_if<TList>(&instruction->value))
+        {
+            for (auto& item : *list)
+                stack.push_back(&item);
+        }
+    }
+    return count;
+}
+
+static void Run(const std::string& Name, const std::string& Source, double Seconds)
+{
+    Lexer lexer("bench", Source);
+    Parser parser;
+    if (!parser.Parse(lexer))
+    {
+        std::cout << Name << ": parse error\n";
+        return;
+    }
+
+    auto scope(Heap::New<Construct>());
+    auto a(Heap::New<Construct>());
+    a->Set("b", 10);
+    scope->Set("a", a);
+    scope->Set("x", 2.5);
+    scope->Set("f", Heap::New<Function>([](Construct& scope) { return Value(7); }));
+
+    enum class Mode { Tree, Bytecode, Superinstructions };
+#ifdef PLANG_PROFILE_OPCODES
+    const Mode modes[] = { Mode::Bytecode }; //profile the operations without superinstructions
+#else
+    const Mode modes[] = { Mode::Tree, Mode::Bytecode, Mode::Superinstructions };
+#endif
+    for (auto mode : modes)
+    {
+        Script::evaluationMode = (mode == Mode::Tree ? Script::EvaluationMode::Tree : Script::EvaluationMode::Bytecode);
+        Bytecode::superinstructions = (mode == Mode::Superinstructions);
+        Script script(parser.root, parser.arena);
+        script.Evaluate(scope); //compile
+
+        size_t evaluations = 0;
+        auto start = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed;
+        do
+        {
+            for (int i = 0; i < 1000; ++i)
+                script.Evaluate(scope);
+            evaluations += 1000;
+            elapsed = std::chrono::steady_clock::now() - start;
+        } while (elapsed.count() < Seconds);
+
+        auto perSecond = evaluations / elapsed.count();
+        if (mode == Mode::Tree)
+        {
+            std::cout << std::setw(12) << Name << "  tree      " << std::setw(10) << (size_t)perSecond << " evaluations/s  "
+                      << std::setw(12) << (size_t)(perSecond * CountInstructions(parser.root)) << " nodes/s\n";
+        }
+        else
+        {
+            auto stats = script.code->CacheStats();
+            std::cout << std::setw(12) << Name << (mode == Mode::Bytecode ? "  bytecode  " : "  fused     ") << std::setw(10) << (size_t)perSecond << " evaluations/s  "
+                      << std::setw(12) << (size_t)(perSecond * CountOperations(*script.code)) << " instructions/s  "
+                      << std::setw(6) << std::fixed << std::setprecision(2) << (100.0 * stats.hits / std::max<uint64_t>(stats.hits + stats.misses, 1)) << "% cache hits\n";
+        }
+    }
+}
+
+#ifdef PLANG_PROFILE_OPCODES
+static void PrintProfile(size_t Count)
+{
+    struct Sequence
+    {
+        uint64_t count;
+        std::string name;
+    };
+    std::vector<Sequence> pairs, triples;
+    uint64_t total = 0;
+    for (size_t a = 0; a < OpcodeCount; ++a)
+    {
+        for (size_t b = 0; b < OpcodeCount; ++b)
+        {
+            auto name = std::string(Bytecode::Name((Opcode)a)) + " " + Bytecode::Name((Opcode)b);
+            total += Bytecode::profile.pairs[a][b];
+            pairs.push_back({ Bytecode::profile.pairs[a][b], name });
+            for (size_t c = 0; c < OpcodeCount; ++c)
+                triples.push_back({ Bytecode::profile.triples[a][b][c], name + " " + Bytecode::Name((Opcode)c) });
+        }
+    }
+
+    for (auto sequences : { &pairs, &triples })
+    {
+        std::sort(sequences->begin(), sequences->end(), [](const Sequence& a, const Sequence& b) { return a.count > b.count; });
+        std::cout << "\n" << (sequences == &pairs ? "pairs" : "triples") << ":\n";
+        for (size_t i = 0; i < Count && i < sequences->size() && (*sequences)[i].count > 0; ++i)
+            std::cout << std::setw(8) << std::fixed << std::setprecision(2) << (100.0 * (*sequences)[i].count / total) << "%  " << (*sequences)[i].name << "\n";
+    }
+}
+#endif
+
+int main(int ac, const char* av[])
+{
+    double seconds = (ac > 1 ? atof(av[1]) : 1.0);
+    std::cout << "dispatch: " << Bytecode::DispatchMode() << "\n";
+
+    Run("arithmetic", "1 + 2 * 3 - 4 / 2 + (5 % 3) * 7 - 8 + 9 * 10 - 11 / 3 + 12;", seconds);
+    Run("names", "a.b + x * a.b - x + a.b * 2;", seconds);
+    Run("calls", "f(1, f(2, 3), f(f(4)), [x, a.b, \"s\"]);", seconds);
+    Run("strings", "f(\"<li>\", x, \"</li>\", \"<li>\", a.b, \"</li>\", \"<li>\", \"text\", \"</li>\");", seconds);
+    Run("expressions", "((p) { f(1, 2); })(3) + ((p) { 4 * 5; })(6);", seconds);
+#ifdef PLANG_PROFILE_OPCODES
+    PrintProfile(12);
+#endif
+    return 0;
+}
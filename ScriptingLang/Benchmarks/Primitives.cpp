@@ -0,0 +1,66 @@
+//Primitive constructs: counts the heap allocations made creating Int, Float, String and List constructs and looking up
+//properties of numbers, and how many of each can be made per second
+#include "pch.hpp"
+#include "Construct.hpp"
+#include <chrono>
+#include <cstdlib>
+
+using namespace Plang;
+
+static size_t allocations = 0;
+
+void* operator new(size_t Size)
+{
+    ++allocations;
+    if (auto memory = std::malloc(Size != 0 ? Size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+void operator delete(void* Memory) noexcept { std::free(Memory); }
+void operator delete(void* Memory, size_t) noexcept { std::free(Memory); }
+
+template <class TFunction>
+static void Run(const std::string& Name, TFunction Function, double Seconds)
+{
+    constexpr size_t Batch = 1000;
+
+    //count the allocations of one batch, after the first has created any shared state
+    for (size_t i = 0; i < Batch; ++i)
+        Function(i);
+    auto before = allocations;
+    for (size_t i = 0; i < Batch; ++i)
+        Function(i);
+    auto perRun = (double)(allocations - before) / Batch;
+
+    using Clock = std::chrono::steady_clock;
+    size_t runs = 0;
+    auto start = Clock::now();
+    std::chrono::duration<double> elapsed;
+    do
+    {
+        for (size_t i = 0; i < Batch; ++i)
+            Function(i);
+        runs += Batch;
+        elapsed = Clock::now() - start;
+    } while (elapsed.count() < Seconds);
+
+    std::cout << std::left << std::setw(20) << Name << std::right
+              << std::setw(6) << std::setprecision(2) << std::fixed << perRun << " allocations"
+              << std::setw(10) << std::setprecision(2) << (runs / elapsed.count() / 1e6) << "M/s\n";
+}
+
+int main(int ac, char* av[])
+{
+    double seconds = (ac > 1 ? std::atof(av[1]) : 0.5);
+
+    std::cout << "Per construct (or lookup):\n";
+    Run("Int", [](size_t i) { Int value((TInt)i); }, seconds);
+    Run("heap Int", [](size_t i) { auto value(Heap::New<Int>((TInt)i)); }, seconds);
+    Run("heap Float", [](size_t i) { auto value(Heap::New<Float>((TFloat)i)); }, seconds);
+    Run("heap String", [](size_t i) { auto value(Heap::New<String>("text")); }, seconds);
+    Run("heap List", [](size_t i) { auto value(Heap::New<List>()); }, seconds);
+
+    Value number(5);
+    Run("Int property", [&](size_t i) { auto property(number.Get("!")); }, seconds);
+    return 0;
+}
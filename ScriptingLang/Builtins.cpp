@@ -0,0 +1,146 @@
+#include "pch.hpp"
+#include "Builtins.hpp"
+
+using namespace Plang;
+
+using Operand = Builtins::Operand;
+
+static inline bool IsNumber(const Operand& value)
+{
+    return std::holds_alternative<TInt>(value) || std::holds_alternative<TFloat>(value);
+}
+
+static inline TFloat ToFloat(const Operand& value)
+{
+    if (auto i = std::get_if<TInt>(&value))
+        return (TFloat)*i;
+    return std::get<TFloat>(value);
+}
+
+static inline bool IsTrue(const Operand& value)
+{
+    if (auto i = std::get_if<TInt>(&value))
+        return *i != 0;
+    return std::get<TFloat>(value) != 0;
+}
+
+template <typename T>
+static Operand Compare(std::string_view op, const T& a, const T& b)
+{
+    if (op == "<")  return (TInt)(a < b);
+    if (op == "<=") return (TInt)(a <= b);
+    if (op == ">")  return (TInt)(a > b);
+    if (op == ">=") return (TInt)(a >= b);
+    if (op == "==") return (TInt)(a == b);
+    if (op == "!=") return (TInt)(a != b);
+    return nullptr;
+}
+
+static Operand ApplyInt(std::string_view op, TInt a, TInt b)
+{
+    //overflow wraps
+    auto ua = (uint64_t)a, ub = (uint64_t)b;
+    if (op == "+") return (TInt)(ua + ub);
+    if (op == "-") return (TInt)(ua - ub);
+    if (op == "*") return (TInt)(ua * ub);
+    if (op == "/" || op == "%")
+    {
+        if (b == 0 || (a == std::numeric_limits<TInt>::min() && b == -1))
+            return nullptr;
+        return (op == "/" ? a / b : a % b);
+    }
+    if (op == "<<" || op == ">>")
+    {
+        if (b < 0 || b > 63)
+            return nullptr;
+        return (op == "<<" ? (TInt)(ua << b) : a >> b);
+    }
+    if (op == "&") return a & b;
+    if (op == "|") return a | b;
+    if (op == "^") return a ^ b;
+    return Compare(op, a, b);
+}
+
+static Operand ApplyFloat(std::string_view op, TFloat a, TFloat b)
+{
+    if (op == "+") return a + b;
+    if (op == "-") return a - b;
+    if (op == "*") return a * b;
+    if (op == "/") return a / b;
+    if (op == "%") return std::fmod(a, b);
+    return Compare(op, a, b);
+}
+
+Operand Builtins::Apply(std::string_view Operator, const Operand& Left, const Operand& Right)
+{
+    auto& op = Operator;
+
+    //prefix
+    if (std::holds_alternative<std::nullptr_t>(Right))
+    {
+        if (!IsNumber(Left))
+            return nullptr;
+
+        auto i = std::get_if<TInt>(&Left);
+        if (op == "+") return Left;
+        if (op == "-") return i != nullptr ? (TInt)(0 - (uint64_t)*i) : Operand(-std::get<TFloat>(Left));
+        if (op == "!") return (TInt)!IsTrue(Left);
+        if (op == "~" && i != nullptr) return ~*i;
+        return nullptr;
+    }
+
+    if (IsNumber(Left) && IsNumber(Right))
+    {
+        if (op == "&&") return (TInt)(IsTrue(Left) && IsTrue(Right));
+        if (op == "||") return (TInt)(IsTrue(Left) || IsTrue(Right));
+
+        if (std::holds_alternative<TInt>(Left) && std::holds_alternative<TInt>(Right))
+            return ApplyInt(op, std::get<TInt>(Left), std::get<TInt>(Right));
+        return ApplyFloat(op, ToFloat(Left), ToFloat(Right));
+    }
+
+    auto a = std::get_if<std::string>(&Left), b = std::get_if<std::string>(&Right);
+    if (a != nullptr && b != nullptr)
+    {
+        if (op == "+") return *a + *b;
+        return Compare(op, *a, *b);
+    }
+
+    return nullptr;
+}
+
+Value Builtins::Call(const Instruction& Call, const Tuple& Arguments)
+{
+    auto& children = std::get<TList>(Call.value);
+    auto& callee = children[0];
+    auto& instructions = std::get<TList>(children[1].value);
+    if (callee.type != InstructionType::Identifier || callee.symbol == NoSymbol || Arguments.Length() != 2 || instructions.size() != 2)
+        return Undefined;
+
+    Operand operands[2];
+    for (size_t i = 0; i < 2; ++i)
+    {
+        //only a missing operand is left null. An undefined value is an error
+        if (instructions[i].type == InstructionType::Unknown)
+            continue;
+
+        auto& argument = Arguments[i];
+        if (argument.IsInt())
+            operands[i] = argument.AsInt();
+        else if (argument.IsFloat())
+            operands[i] = argument.AsFloat();
+        else if (argument.Type() == ConstructType::String)
+            operands[i] = argument.As<String>().value;
+        else
+            return Undefined;
+    }
+
+    auto result = Apply(Symbols::Name(callee.symbol), operands[0], operands[1]);
+    if (auto i = std::get_if<TInt>(&result))
+        return *i;
+    if (auto f = std::get_if<TFloat>(&result))
+        return *f;
+    if (auto s = std::get_if<std::string>(&result))
+        return Heap::New<String>(*s);
+    return Undefined;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Instruction.hpp"
+#include "Construct.hpp"
+
+namespace Plang
+{
+    //The built in operators on ints, floats, and strings. These are used when an operator is not defined in scope (and to fold constants)
+    class Builtins
+    {
+    public:
+        using Operand = std::variant<std::nullptr_t, TInt, TFloat, std::string>;
+
+        //Apply a built in operator. Prefix operators have a null right operand.
+        //Returns null if the operator is not built in or does not apply to the operands (e.g. dividing by zero)
+        static Operand Apply(std::string_view Operator, const Operand& Left, const Operand& Right);
+
+        //Call the built in operator named by a call instruction's callee with int, float, and string arguments.
+        //The missing operand of a prefix or postfix call is an unknown instruction. Returns undefined if it does not apply
+        static Value Call(const Instruction& Call, const Tuple& Arguments);
+    };
+};
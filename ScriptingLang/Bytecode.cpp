@@ -0,0 +1,466 @@
+#include "pch.hpp"
+#include "Bytecode.hpp"
+#include "Builtins.hpp"
+#include "Parser.hpp"
+
+using namespace Plang;
+
+namespace
+{
+    constexpr uint32_t NoName = ~(uint32_t)0;
+
+    class Compiler
+    {
+    public:
+        Compiler(Bytecode& Code) : code(Code) { }
+
+        void Compile(const Instruction& Root)
+        {
+            //instructions are compiled in the order the tree walker visits them (children first), tracking how many values it would have pushed
+            struct Frame
+            {
+                const Instruction* instruction;
+                size_t index;
+            };
+            std::vector<Frame> stack { { &Root, 0 } };
+            while (!stack.empty())
+            {
+                auto& top = stack.back();
+                auto& instruction = *top.instruction;
+                auto children = std::get_if<TList>(&instruction.value);
+
+                if (children != nullptr)
+                {
+                    if (instruction.type == InstructionType::Accessor)
+                    {
+                        CompileAccessor(*children);
+                        stack.pop_back();
+                        continue;
+                    }
+                    if (instruction.type == InstructionType::Expression)
+                    {
+                        code.scripts.push_back(std::make_shared<Bytecode>(children->at(1))); //the body
+                        Push(Opcode::MakeScript, (uint32_t)code.scripts.size() - 1);
+                        stack.pop_back();
+                        continue;
+                    }
+                    if (top.index < children->size())
+                    {
+                        auto& child = (*children)[top.index++];
+                        stack.push_back({ &child, 0 }); //invalidates top
+                        continue;
+                    }
+                }
+
+                switch (instruction.type)
+                {
+                case InstructionType::Int:
+                    Push(Opcode::LoadConstant, AddInt(std::get<TInt>(instruction.value)));
+                    break;
+                case InstructionType::Float:
+                    Push(Opcode::LoadConstant, AddFloat(std::get<TFloat>(instruction.value)));
+                    break;
+                case InstructionType::String:
+                    Push(Opcode::LoadConstant, AddString(std::get<TString>(instruction.value)));
+                    break;
+                case InstructionType::Identifier:
+                    if (auto name = std::get_if<TString>(&instruction.value))
+                        Push(Opcode::LoadName, AddName(*name));
+                    else
+                        Push(Opcode::BadValue);
+                    break;
+                case InstructionType::Unknown:
+                    Push(Opcode::LoadUndefined);
+                    break;
+
+                case InstructionType::List:
+                {
+                    auto count = children->size();
+                    if (count > height)
+                    {
+                        Unbalanced("Missing operands @ " + (std::string)instruction.location);
+                        break;
+                    }
+                    height -= count;
+                    Push(Opcode::MakeList, (uint32_t)count);
+                    break;
+                }
+                case InstructionType::Call:
+                {
+                    auto count = std::get<TList>(children->at(1).value).size();
+                    if (count + 1 > height)
+                    {
+                        Unbalanced("Missing operands @ " + (std::string)instruction.location);
+                        break;
+                    }
+                    height -= count + 1;
+                    code.calls.push_back(instruction);
+                    Push(Opcode::Call, (uint32_t)count, (uint32_t)code.calls.size() - 1);
+                    break;
+                }
+
+                default:
+                    break;
+                }
+
+                stack.pop_back();
+            }
+
+            if (height > 1)
+                Unbalanced("Script left " + std::to_string(height) + " values @ " + (std::string)Root.location);
+            else if (height == 1)
+                Emit(Opcode::Return);
+            else
+                Emit(Opcode::ReturnUndefined);
+        }
+
+        //replace sequences of operations with superinstructions. Scripts have no branches, so any sequence can be fused
+        void Fuse()
+        {
+            auto& operations = code.operations;
+            for (size_t i = 0; i + 1 < operations.size();)
+            {
+                auto& first = operations[i];
+                auto& second = operations[i + 1];
+                size_t length = 1;
+
+                if (first.opcode == Opcode::LoadName && second.opcode == Opcode::GetProperty && second.a == first.a)
+                {
+                    while (i + length < operations.size() && operations[i + length].opcode == Opcode::GetProperty && operations[i + length].a == first.a)
+                        ++length;
+                    first.opcode = Opcode::LoadPath;
+                    first.c = (uint32_t)length - 1;
+                }
+                else if (first.opcode == Opcode::LoadName && second.opcode == Opcode::LoadName)
+                {
+                    first.opcode = Opcode::LoadNames;
+                    length = 2;
+                }
+                else if (first.opcode == Opcode::LoadConstant && second.opcode == Opcode::Call)
+                {
+                    first.opcode = Opcode::CallConstant;
+                    length = 2;
+                }
+                else if (first.opcode == Opcode::Call && second.opcode == Opcode::Return && second.a == first.a)
+                {
+                    first.opcode = Opcode::CallReturn;
+                    length = 2;
+                }
+
+                i += length;
+            }
+        }
+
+    protected:
+        Bytecode& code;
+        size_t height = 0; //the number of values on the tree walker's stack
+
+        //the constant each literal was added as
+        std::unordered_map<TInt, uint32_t> ints;
+        std::unordered_map<uint64_t, uint32_t> floats; //by their bits, so that 0.0 and -0.0 stay distinct
+        std::unordered_map<TString, uint32_t> strings; //the text is owned by the instructions
+
+        inline void Emit(Opcode opcode, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0)
+        {
+            code.operations.push_back({ opcode, a, b, c });
+        }
+
+        inline void Unbalanced(std::string Message)
+        {
+            code.strings.push_back(std::move(Message));
+            Emit(Opcode::Unbalanced, 0, 0, (uint32_t)code.strings.size() - 1);
+        }
+
+        //emit an operation that writes to the next register
+        inline void Push(Opcode opcode, uint32_t b = 0, uint32_t c = 0)
+        {
+            Emit(opcode, (uint32_t)height, b, c);
+            ++height;
+            code.registerCount = std::max(code.registerCount, height);
+        }
+
+        uint32_t AddConstant(Value&& value)
+        {
+            code.constants.push_back(std::move(value));
+            return (uint32_t)code.constants.size() - 1;
+        }
+        uint32_t AddInt(TInt value)
+        {
+            auto found = ints.find(value);
+            if (found == ints.end())
+                found = ints.emplace(value, AddConstant(value)).first;
+            return found->second;
+        }
+        uint32_t AddFloat(TFloat value)
+        {
+            uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            auto found = floats.find(bits);
+            if (found == floats.end())
+                found = floats.emplace(bits, AddConstant(value)).first;
+            return found->second;
+        }
+        uint32_t AddString(TString value)
+        {
+            auto found = strings.find(value);
+            if (found == strings.end())
+            {
+                auto string = Heap::New<String>(std::string(value));
+                string->Freeze(); //shared by every load
+                found = strings.emplace(value, AddConstant(string)).first;
+            }
+            return found->second;
+        }
+
+        uint32_t AddName(std::string_view name)
+        {
+            code.names.emplace_back(name);
+            return (uint32_t)code.names.size() - 1;
+        }
+
+        void CompileAccessor(const TList& items)
+        {
+            assert(items.size() > 0);
+            if (items[0].type == InstructionType::Unknown)
+                Push(Opcode::LoadUndefined);
+            else
+                Push(Opcode::LoadName, AddName((std::string)items[0]));
+
+            auto target = (uint32_t)height - 1;
+            for (size_t i = 1; i < items.size(); ++i)
+            {
+                auto name = std::get_if<TString>(&items[i].value);
+                code.strings.push_back((std::string)items[i - 1] + "is undefined");
+                Emit(Opcode::GetProperty, target, name != nullptr ? AddName(*name) : NoName, (uint32_t)code.strings.size() - 1);
+            }
+        }
+    };
+}
+
+void Bytecode::Compile()
+{
+    if (compiled)
+        return;
+
+    if (source.type == InstructionType::Deferred)
+        source = Parser::ParseDeferred(source, owner);
+
+    Compiler compiler(*this);
+    compiler.Compile(source);
+    if (superinstructions)
+        compiler.Fuse();
+    caches.resize(names.size());
+    compiled = true;
+}
+
+Bytecode::CacheStatistics Bytecode::CacheStats() const
+{
+    CacheStatistics stats;
+    for (auto& cache : caches)
+    {
+        stats.hits += cache.hits;
+        stats.misses += cache.misses;
+    }
+    for (auto& script : scripts)
+    {
+        auto scriptStats = script->CacheStats();
+        stats.hits += scriptStats.hits;
+        stats.misses += scriptStats.misses;
+    }
+    return stats;
+}
+
+//Operations jump directly to the next operation's handler (labels as values) where supported, which predicts much better than a shared switch.
+//Define PLANG_SWITCH_DISPATCH to use the portable switch instead
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(PLANG_SWITCH_DISPATCH)
+#define PLANG_COMPUTED_GOTO
+#endif
+
+//count the sequences of operations ending with the one about to run (see Bytecode::profile)
+#ifdef PLANG_PROFILE_OPCODES
+#define PROFILE() \
+    do \
+    { \
+        if (history[1] != OpcodeCount) \
+        { \
+            ++profile.pairs[history[1]][(size_t)op->opcode]; \
+            if (history[0] != OpcodeCount) \
+                ++profile.triples[history[0]][history[1]][(size_t)op->opcode]; \
+        } \
+        history[0] = history[1]; \
+        history[1] = (size_t)op->opcode; \
+    } while (false)
+#else
+#define PROFILE()
+#endif
+
+//Handlers with locals must end their scope before NEXT(), since a computed goto does not destroy them
+#ifdef PLANG_COMPUTED_GOTO
+#define OPERATION(name) Do##name:
+#define NEXT() ++op; PROFILE(); goto *handlers[(size_t)op->opcode]
+#else
+#define OPERATION(name) case Opcode::name:
+#define NEXT() continue
+#endif
+
+Bytecode::Profile Bytecode::profile;
+bool Bytecode::superinstructions = true;
+
+const char* Bytecode::DispatchMode()
+{
+#ifdef PLANG_COMPUTED_GOTO
+    return "computed goto";
+#else
+    return "switch";
+#endif
+}
+
+const char* Bytecode::Name(Opcode Opcode)
+{
+    static const char* const names[] =
+    {
+        "LoadConstant", "LoadUndefined", "LoadName",
+        "GetProperty", "MakeList", "MakeScript", "Call",
+        "LoadNames", "LoadPath", "CallConstant", "CallReturn",
+        "Return", "ReturnUndefined", "Unbalanced", "BadValue"
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == OpcodeCount, "Every opcode needs a name");
+    return names[(size_t)Opcode];
+}
+
+Value Bytecode::Run(const AnyRef& Scope, const std::shared_ptr<const void>& Owner)
+{
+    Compile();
+
+    //small scripts keep their registers on the stack
+    constexpr size_t LocalRegisters = 16;
+    Value localRegisters[LocalRegisters];
+    std::vector<Value> registers(registerCount > LocalRegisters ? registerCount : 0);
+    auto r = (registerCount > LocalRegisters ? registers.data() : localRegisters);
+    auto op = operations.data();
+    //shared by the operations and the superinstructions that include them
+    auto getProperty = [&](const Operation& operation)
+    {
+        auto& target = r[operation.a];
+        if (target.IsUndefined())
+            throw strings[operation.c];
+        if (operation.b == NoName)
+            throw std::bad_variant_access();
+        target = Value(caches[operation.b].Get(target.Properties(), names[operation.b]));
+    };
+    auto loadName = [&](const Operation& operation)
+    {
+        r[operation.a] = caches[operation.b].Get(*Scope, names[operation.b]);
+    };
+    auto call = [&](const Operation& operation)
+    {
+        auto& id = r[operation.a];
+        auto& call = calls[operation.c];
+        auto& callee = std::get<TList>(call.value)[0];
+        Tuple args(r + operation.a + 1, r + operation.a + 1 + operation.b);
+
+        if (id.IsUndefined())
+        {
+            //operators that are not defined in scope fall back to the built in operators
+            auto rval = Builtins::Call(call, args);
+            if (rval.IsUndefined())
+                throw "Undefined (" + (std::string)callee + ") is not a function";
+            return rval;
+        }
+        if (id.Type() == ConstructType::Function)
+            return id.As<Function>().Call(args, Scope);
+        if (id.Type() == ConstructType::Script)
+            return id.As<Script>().Evaluate(args, Scope);
+        throw (std::string)callee + " is not a function";
+    };
+
+#ifdef PLANG_PROFILE_OPCODES
+    size_t history[2] = { OpcodeCount, OpcodeCount }; //the previous two opcodes run by this script
+#endif
+
+#ifdef PLANG_COMPUTED_GOTO
+    //in the same order as Opcode
+    static const void* const handlers[] =
+    {
+        &&DoLoadConstant, &&DoLoadUndefined, &&DoLoadName,
+        &&DoGetProperty, &&DoMakeList, &&DoMakeScript, &&DoCall,
+        &&DoLoadNames, &&DoLoadPath, &&DoCallConstant, &&DoCallReturn,
+        &&DoReturn, &&DoReturnUndefined, &&DoUnbalanced, &&DoBadValue
+    };
+    static_assert(sizeof(handlers) / sizeof(handlers[0]) == OpcodeCount, "Every opcode needs a handler");
+    PROFILE();
+    goto *handlers[(size_t)op->opcode];
+#else
+    for (;; ++op)
+    {
+    PROFILE();
+    switch (op->opcode)
+    {
+#endif
+
+    OPERATION(LoadConstant)
+        r[op->a] = constants[op->b];
+        NEXT();
+    OPERATION(LoadUndefined)
+        r[op->a] = Undefined;
+        NEXT();
+    OPERATION(LoadName)
+        loadName(*op);
+        NEXT();
+
+    OPERATION(GetProperty)
+        getProperty(*op);
+        NEXT();
+
+    OPERATION(MakeList)
+    {
+        auto list(Heap::New<List>());
+        list->value.assign(r + op->a, r + op->a + op->b);
+        r[op->a] = list;
+    }
+    NEXT();
+
+    OPERATION(MakeScript)
+    {
+        auto& script = scripts[op->b];
+        auto value(Heap::New<Script>(script->source, owner != nullptr ? owner : Owner));
+        value->code = script;
+        r[op->a] = value;
+    }
+    NEXT();
+
+    OPERATION(Call)
+        r[op->a] = call(*op);
+        NEXT();
+
+    OPERATION(LoadNames)
+        loadName(*op);
+        loadName(*++op);
+        NEXT();
+    OPERATION(LoadPath)
+        loadName(*op);
+        for (auto last = op + op->c; op != last;)
+            getProperty(*++op);
+        NEXT();
+    OPERATION(CallConstant)
+        r[op->a] = constants[op->b];
+        ++op;
+        r[op->a] = call(*op);
+        NEXT();
+    OPERATION(CallReturn)
+        return call(*op);
+
+    OPERATION(Return)
+        return r[op->a];
+    OPERATION(ReturnUndefined)
+        return Undefined;
+    OPERATION(Unbalanced)
+        throw strings[op->c];
+    OPERATION(BadValue)
+        throw std::bad_variant_access();
+
+#ifndef PLANG_COMPUTED_GOTO
+    }
+    }
+#endif
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Instruction.hpp"
+#include "Construct.hpp"
+#include "PropertyCache.hpp"
+
+namespace Plang
+{
+    enum class Opcode : uint8_t
+    {
+        LoadConstant, //a = constants[b]
+        LoadUndefined, //a = Undefined
+        LoadName, //a = scope[names[b]], cached in caches[b]
+        GetProperty, //a = a[names[b]], cached in caches[b]. Throws strings[c] if a is undefined
+        MakeList, //a = [a .. a + b)
+        MakeScript, //a = new Script(scripts[b])
+        Call, //a = a(a + 1 .. a + 1 + b), calls[c] is the call instruction
+
+        //Superinstructions, chosen from the most common sequences in the interpreter benchmark (see Benchmarks/Interpreter.cpp).
+        //Each replaces the first operation of its sequence and runs the whole sequence in one dispatch,
+        //reading the operands of the rest in place (which are then skipped)
+        LoadNames, //LoadName LoadName
+        LoadPath, //LoadName followed by c GetProperty on the same register (foo.bar.baz)
+        CallConstant, //LoadConstant Call (a call whose last argument is a literal, e.g. x + 1)
+        CallReturn, //Call Return (returning the result of a call)
+
+        Return, //return a
+        ReturnUndefined,
+        Unbalanced, //throw strings[c]: the script left more than one value (or a list or call was missing operands)
+        BadValue, //an instruction had the wrong type of value
+    };
+    constexpr size_t OpcodeCount = (size_t)Opcode::BadValue + 1;
+
+    struct Operation
+    {
+        Opcode opcode;
+        uint32_t a = 0;
+        uint32_t b = 0;
+        uint32_t c = 0;
+    };
+
+    //A script compiled to a linear list of operations on registers. Each value the tree walker (Script::EvaluateTree) would push
+    //is given its own register, so both produce the same results.
+    //Compiled when first run. Expressions in the script are compiled separately (and also only when they are first called)
+    class Bytecode
+    {
+    public:
+        Bytecode(const Instruction& Source) : source(Source) { }
+
+        Value Run(const AnyRef& Scope, const std::shared_ptr<const void>& Owner); //Owner is passed on to the scripts this creates (if the source was not deferred)
+
+        void Compile(); //does nothing if already compiled
+        static const char* DispatchMode(); //how the interpreter loop dispatches operations (chosen when built)
+        static const char* Name(Opcode Opcode);
+
+        static bool superinstructions; //whether scripts compiled after this is set use superinstructions (on by default)
+
+        //The property cache hits and misses of this script and the expressions in it that have been compiled
+        struct CacheStatistics
+        {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+        };
+        CacheStatistics CacheStats() const;
+        inline bool IsCompiled() const { return compiled; }
+
+        Instruction source; //the instructions this was compiled from
+        std::shared_ptr<const void> owner; //keeps the source alive once parsed, if it was deferred (see Parser::ParseDeferred)
+        std::vector<Operation> operations;
+        size_t registerCount = 0;
+
+        std::vector<Value> constants; //the script's literals, each value once. String literals are shared by every load, so are frozen
+        std::vector<std::string> strings; //error messages
+        std::vector<std::string> names; //not shared between lookups, so each has its own cache
+        std::vector<PropertyCache> caches; //one for each name
+        std::vector<Instruction> calls;
+        std::vector<std::shared_ptr<Bytecode>> scripts;
+
+        //The number of times each sequence of two and three operations was dispatched, in all scripts.
+        //Only counted when built with PLANG_PROFILE_OPCODES
+        struct Profile
+        {
+            uint64_t pairs[OpcodeCount][OpcodeCount];
+            uint64_t triples[OpcodeCount][OpcodeCount][OpcodeCount];
+        };
+        static Profile profile;
+
+    protected:
+        bool compiled = false;
+    };
+};
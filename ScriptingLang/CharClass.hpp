@@ -0,0 +1,84 @@
+#pragma once
+
+#include "pch.hpp"
+
+//Character classification for the lexer. ASCII characters are looked up in a table built at compile time,
+//other characters are decoded from UTF-8 and classified by codepoint
+namespace Plang
+{
+    namespace CharClass
+    {
+        enum : uint8_t
+        {
+            Whitespace  = 1 << 0, //control characters and space
+            Special     = 1 << 1, //characters that form operators (+ - * % ...)
+            Punctuation = 1 << 2, //enclosers, terminators, separators and accessors
+            Digit       = 1 << 3,
+            NonAscii    = 1 << 4, //part of a UTF-8 sequence
+
+            LiteralEnd = Whitespace | Special | Punctuation,
+        };
+
+        constexpr char specials[] = "+-*/%!^&|~=:?<>";
+        constexpr char punctuation[] = "()[]{};,.";
+
+        struct Table
+        {
+            uint8_t classes[256];
+        };
+
+        constexpr Table MakeTable()
+        {
+            Table table { };
+            for (unsigned ch = 0; ch <= ' '; ++ch)
+                table.classes[ch] |= Whitespace;
+            for (size_t i = 0; i < sizeof(specials) - 1; ++i)
+                table.classes[(unsigned char)specials[i]] |= Special;
+            for (size_t i = 0; i < sizeof(punctuation) - 1; ++i)
+                table.classes[(unsigned char)punctuation[i]] |= Punctuation;
+            for (unsigned ch = '0'; ch <= '9'; ++ch)
+                table.classes[ch] |= Digit;
+            for (unsigned ch = 0x80; ch < 256; ++ch)
+                table.classes[ch] |= NonAscii;
+            return table;
+        }
+
+        constexpr Table table = MakeTable();
+
+        constexpr inline uint8_t Of(unsigned char Char) { return table.classes[Char]; }
+        constexpr inline bool Is(unsigned char Char, uint8_t Classes) { return (table.classes[Char] & Classes) != 0; }
+
+        //Unicode whitespace outside of ASCII
+        constexpr inline bool IsUnicodeWhitespace(codepoint Char)
+        {
+            return (Char == 0x85 || Char == 0xA0 || Char == 0x1680 ||
+                    (Char >= 0x2000 && Char <= 0x200A) ||
+                    Char == 0x2028 || Char == 0x2029 || Char == 0x202F || Char == 0x205F ||
+                    Char == 0x3000 || Char == 0xFEFF);
+        }
+
+        //Decode a UTF-8 sequence. Returns the length of the sequence, or 0 if it is cut off by End.
+        //Invalid bytes decode as themselves with a length of 1
+        inline size_t DecodeUtf8(const char* Begin, const char* End, codepoint& Char)
+        {
+            auto lead = (unsigned char)*Begin;
+            size_t length = (lead >= 0xF0 && lead <= 0xF4) ? 4 : (lead >= 0xE0) ? 3 : (lead >= 0xC2) ? 2 : 1;
+            Char = lead;
+            if (length == 1 || lead > 0xF4)
+                return 1;
+            if ((size_t)(End - Begin) < length)
+                return 0;
+
+            codepoint value = lead & (0x7F >> length);
+            for (size_t i = 1; i < length; ++i)
+            {
+                auto next = (unsigned char)Begin[i];
+                if ((next & 0xC0) != 0x80)
+                    return 1;
+                value = (value << 6) | (next & 0x3F);
+            }
+            Char = value;
+            return length;
+        }
+    };
+};
@@ -2,8 +2,8 @@
 #include "Construct.hpp"
 #include "Parser.hpp"
 #include "Lexer.hpp"
-
-Plang::AnyRef Plang::Undefined(nullptr);
+#include "Builtins.hpp"
+#include "Bytecode.hpp"
 
 std::string Plang::TypeToString(const Plang::ConstructType& Type)
 {
@@ -27,30 +27,141 @@ std::string Plang::TypeToString(const Plang::ConstructType& Type)
         return "Unknown";
     }
 }
-Plang::AnyRef& Plang::Construct::Set(const std::string& Name, const Plang::AnyRef& Ref, bool SearchParents)
+
+Plang::Construct::Construct(const ::Array<std::pair<std::string, Value>>& Defaults)
 {
-	auto scope = this;
+    for (size_t i = 0; i < Defaults.Length(); ++i)
+        Set(Defaults[i].first, Defaults[i].second);
+}
 
-	while (scope->prototype != nullptr)
-	{
-		if (scope->properties.find(Name) != scope->properties.end())
-			break;
+Plang::Construct::Construct(const Plang::Construct& Other)
+    : Counted(), prototype(Other.prototype), shape(Other.shape), slots(Other.slots), removals(Other.removals)
+{
+    if (Other.dictionary != nullptr)
+        dictionary = std::make_unique<Dictionary>(*Other.dictionary);
+}
 
-		scope = scope->prototype.get();
-	}
+Plang::Construct& Plang::Construct::operator = (const Plang::Construct& Other)
+{
+    if (&Other != this)
+    {
+        prototype = Other.prototype;
+        shape = Other.shape;
+        dictionary = (Other.dictionary != nullptr ? std::make_unique<Dictionary>(*Other.dictionary) : nullptr);
+        slots = Other.slots;
+        removals = Other.removals;
+    }
+    return *this;
+}
+
+void Plang::Construct::Slots::Add(const Plang::Value& Value)
+{
+    if (count < InlineCount)
+        first[count] = Value;
+    else
+        rest.push_back(Value);
+    ++count;
+}
+
+void Plang::Construct::Slots::Remove(size_t Slot)
+{
+    for (auto i = Slot; i + 1 < count; ++i)
+        (*this)[i] = std::move((*this)[i + 1]);
+
+    --count;
+    if (count >= InlineCount)
+        rest.pop_back();
+    else
+        first[count] = nullptr;
+}
+
+uint32_t Plang::Construct::FindSlot(std::string_view Name) const
+{
+    if (shape != nullptr)
+        return shape->Find(Name);
+
+    auto slot = dictionary->slots.find(std::string(Name));
+    return (slot != dictionary->slots.end() ? slot->second : Shape::NotFound);
+}
+
+const std::string& Plang::Construct::SlotName(size_t Slot) const
+{
+    return (shape != nullptr ? shape->Name(Slot) : dictionary->names[Slot]);
+}
+
+Plang::Value& Plang::Construct::AddProperty(const std::string& Name, const Plang::Value& Value)
+{
+    if (shape != nullptr && shape->Count() >= Shape::MaxCount)
+        UseDictionary();
+
+    if (shape != nullptr)
+        shape = shape->Add(Name);
+    else
+    {
+        dictionary->slots[Name] = (uint32_t)dictionary->names.size();
+        dictionary->names.push_back(Name);
+    }
+    slots.Add(Value);
+    return slots[slots.Count() - 1];
+}
+
+void Plang::Construct::RemoveProperty(size_t Slot)
+{
+    if (shape != nullptr && ++removals > MaxRemovals)
+        UseDictionary();
+
+    if (shape != nullptr)
+        shape = shape->Remove(Slot);
+    else
+    {
+        dictionary->slots.erase(dictionary->names[Slot]);
+        dictionary->names.erase(dictionary->names.begin() + Slot);
+        for (auto i = Slot; i < dictionary->names.size(); ++i)
+            dictionary->slots[dictionary->names[i]] = (uint32_t)i;
+    }
+    slots.Remove(Slot);
+}
+
+void Plang::Construct::UseDictionary()
+{
+    dictionary = std::make_unique<Dictionary>();
+    dictionary->names.reserve(Count());
+    for (size_t i = 0; i < Count(); ++i)
+    {
+        dictionary->slots[shape->Name(i)] = (uint32_t)i;
+        dictionary->names.push_back(shape->Name(i));
+    }
+    shape = nullptr;
+}
 
-    return (scope->properties[Name] = Ref);
+Plang::Value& Plang::Construct::Set(const std::string& Name, const Plang::Value& Value, bool SearchParents)
+{
+    if (frozen)
+        throw std::string("Constants cannot be modified");
+
+    auto slot = FindSlot(Name);
+    if (slot != Shape::NotFound)
+        return (slots[slot] = Value);
+
+    //only set in a parent scope that already defines it. Missing properties are added here, never to a shared prototype
+    for (auto scope = prototype.get(); SearchParents && scope != nullptr && !scope->shared; scope = scope->prototype.get())
+    {
+        slot = scope->FindSlot(Name);
+        if (slot != Shape::NotFound)
+            return (scope->slots[slot] = Value);
+    }
+    return AddProperty(Name, Value);
 }
 
-Plang::AnyRef& Plang::Construct::Get(const std::string& Name, bool SearchParents)
+Plang::Value& Plang::Construct::Get(const std::string& Name, bool SearchParents)
 {
     auto scope = this;
 
     do
     {
-        auto value = scope->properties.find(Name);
-        if (value != scope->properties.end())
-            return value->second;
+        auto slot = scope->FindSlot(Name);
+        if (slot != Shape::NotFound)
+            return scope->slots[slot];
 
         scope = scope->prototype.get();
     } while (scope != nullptr && SearchParents);
@@ -58,15 +169,15 @@ Plang::AnyRef& Plang::Construct::Get(const std::string& Name, bool SearchParents
     return Plang::Undefined;
 }
 
-const Plang::AnyRef& Plang::Construct::Get(const std::string& Name, bool SearchParents) const
+const Plang::Value& Plang::Construct::Get(const std::string& Name, bool SearchParents) const
 {
     auto scope = this;
 
     do
     {
-        auto value = scope->properties.find(Name);
-        if (value != scope->properties.end())
-            return value->second;
+        auto slot = scope->FindSlot(Name);
+        if (slot != Shape::NotFound)
+            return scope->slots[slot];
 
         scope = scope->prototype.get();
     } while (scope != nullptr && SearchParents);
@@ -80,7 +191,7 @@ bool Plang::Construct::Has(const std::string& Name, bool SearchParents) const
 
     do
     {
-        if (scope->properties.find(Name) != scope->properties.end())
+        if (scope->FindSlot(Name) != Shape::NotFound)
             return true;
 
         scope = scope->prototype.get();
@@ -91,10 +202,13 @@ bool Plang::Construct::Has(const std::string& Name, bool SearchParents) const
 
 bool Plang::Construct::Remove(const std::string& Name)
 {
-    auto value = properties.find(Name);
-    if (value != properties.end())
+    if (frozen)
+        throw std::string("Constants cannot be modified");
+
+    auto slot = FindSlot(Name);
+    if (slot != Shape::NotFound)
     {
-        properties.erase(value);
+        RemoveProperty(slot);
         return true;
     }
     return false;
@@ -102,18 +216,99 @@ bool Plang::Construct::Remove(const std::string& Name)
 
 Plang::Construct& Plang::Construct::Merge(const Plang::Construct& Other, bool Overwrite)
 {
-    if (&Other != this)
+    if (&Other == this)
+        return *this;
+    if (frozen)
+        throw std::string("Constants cannot be modified");
+
+    //without properties of its own, this can share the other's shape
+    if (Count() == 0 && dictionary == nullptr && Other.shape != nullptr)
     {
-        for (auto& var : Other.properties)
-        {
-            if (Overwrite || properties.find(var.first) != properties.end())
-                properties.insert(var);
-        }
+        shape = Other.shape;
+        slots = Other.slots;
+        return *this;
+    }
+
+    for (size_t i = 0; i < Other.Count(); ++i)
+    {
+        auto& name = Other.SlotName(i);
+        auto slot = FindSlot(name);
+        if (slot == Shape::NotFound)
+            AddProperty(name, Other.slots[i]);
+        else if (Overwrite)
+            slots[slot] = Other.slots[i];
     }
 
     return *this;
 }
 
+void Plang::Construct::Trace(const std::function<void(Construct&)>& Visit) const
+{
+    if (prototype != nullptr)
+        Visit(*prototype);
+    for (size_t i = 0; i < Count(); ++i)
+    {
+        if (slots[i].IsReference())
+            Visit(*slots[i].AsReference());
+    }
+}
+
+void Plang::Construct::Release(std::vector<Plang::Value>& Released)
+{
+    Released.push_back(std::move(prototype));
+    for (size_t i = 0; i < Count(); ++i)
+    {
+        if (slots[i].IsReference())
+            Released.push_back(std::move(slots[i]));
+    }
+}
+
+void Plang::List::Trace(const std::function<void(Construct&)>& Visit) const
+{
+    Construct::Trace(Visit);
+    for (auto& item : value)
+    {
+        if (item.IsReference())
+            Visit(*item.AsReference());
+    }
+}
+
+void Plang::List::Release(std::vector<Plang::Value>& Released)
+{
+    Construct::Release(Released);
+    for (auto& item : value)
+    {
+        if (item.IsReference())
+            Released.push_back(std::move(item));
+    }
+}
+
+void Plang::Function::Trace(const std::function<void(Construct&)>& Visit) const
+{
+    Construct::Trace(Visit);
+    if (boundScope != nullptr)
+        Visit(*boundScope);
+}
+
+void Plang::Function::Release(std::vector<Plang::Value>& Released)
+{
+    Construct::Release(Released);
+    Released.push_back(std::move(boundScope));
+}
+
+void Plang::Script::Trace(const std::function<void(Construct&)>& Visit) const
+{
+    Construct::Trace(Visit);
+    if (boundScope != nullptr)
+        Visit(*boundScope);
+}
+
+void Plang::Script::Release(std::vector<Plang::Value>& Released)
+{
+    Construct::Release(Released);
+    Released.push_back(std::move(boundScope));
+}
+
 std::ostream& Plang::operator<<(std::ostream& Stream, const Plang::Construct& Construct)
 {
     Stream << TypeToString(Construct.Type()) << "{" << Construct.ToString() << "}";
@@ -122,7 +317,7 @@ std::ostream& Plang::operator<<(std::ostream& Stream, const Plang::Construct& Co
 
 std::ostream& Plang::operator<<(std::ostream& Stream, const Plang::AnyRef& Ref)
 {
-    if (Ref == Plang::Undefined)
+    if (Ref == nullptr)
         Stream << "Undefined";
     else
         Stream << *Ref;
@@ -133,29 +328,54 @@ std::string Plang::Construct::ToString() const
 {
 	std::string out;
 	out += "{ ";
-	if (properties.size() > 0)
+	for (size_t i = 0; i < Count(); i++)
 	{
-		auto last = --properties.end();
-		for (auto i = properties.begin(); i != properties.end(); i++)
-		{
-			out += i->first + ": " + (i->second == nullptr ? "undefined" : i->second->ToString());
-			if (i != last)
-				out += ", ";
-		}
+		out += SlotName(i) + ": " + slots[i].ToString();
+		if (i < Count() - 1)
+			out += ", ";
 	}
 	out += " } <- " + (prototype == nullptr ? "undefined" : std::to_string((size_t)prototype.get()));
 	return out;
 }
 
-Plang::Construct Plang::Int::Prototype
+//created on first use, as constructs may be created during static initialization
+const Plang::AnyRef& Plang::Construct::Share(const AnyRef& Prototype)
+{
+    Prototype->shared = true;
+    return Prototype;
+}
+
+const Plang::AnyRef& Plang::Int::Prototype()
 {
-    { std::make_pair("!", std::make_shared<Plang::Function>([](Construct& scope)
+    static const AnyRef prototype(Share(Heap::New<Construct>(::Array<std::pair<std::string, Value>>
     {
+        { std::make_pair("!", Heap::New<Plang::Function>([](Construct& scope)
+        {
 
-        return Undefined;
-    })
-    )}
-};
+            return Undefined;
+        })
+        )}
+    })));
+    return prototype;
+}
+
+const Plang::AnyRef& Plang::Float::Prototype()
+{
+    static const AnyRef prototype(Share(Heap::New<Construct>()));
+    return prototype;
+}
+
+const Plang::AnyRef& Plang::String::Prototype()
+{
+    static const AnyRef prototype(Share(Heap::New<Construct>()));
+    return prototype;
+}
+
+const Plang::AnyRef& Plang::List::Prototype()
+{
+    static const AnyRef prototype(Share(Heap::New<Construct>()));
+    return prototype;
+}
 
 Plang::Signature::Signature(const ::Array<Argument> Arguments)
     : arguments(Arguments), nSingles(0)
@@ -170,10 +390,9 @@ Plang::Signature::Signature(const ::Array<Argument> Arguments)
 
 Plang::Signature::Signature(const std::string& ArgsString)
 {
-    std::istringstream iss (ArgsString);
-	Lexer lex ("@", iss);
+	Lexer lex ("@", ArgsString);
     Parser parse;
-    parse.Parse(lex.tokens, true); //todo: maybe return value?
+    parse.Parse(lex, true); //todo: maybe return value?
 
     //skip program and optionally tuple
 
@@ -200,13 +419,13 @@ Plang::Construct Plang::Signature::Parse(const Plang::Tuple& evaluation)
 			size_t nArgs = std::min(nArgsPerList, evaluation.Length() - j);
 			if (nArgs > 0)
 			{
-				auto list(std::make_shared<List>(evaluation.Slice(j, nArgs)));
+				auto list(Heap::New<List>(evaluation.Slice(j, nArgs)));
 				scope.Set(arguments[i].name, list);
 				j += nArgs;
 			}
 			else
 			{
-				scope.Set(arguments[i].name, std::make_shared<List>());
+				scope.Set(arguments[i].name, Heap::New<List>());
 			}
 		}
 		else if (j < evaluation.Length())
@@ -220,7 +439,7 @@ Plang::Construct Plang::Signature::Parse(const Plang::Tuple& evaluation)
     return scope;
 }
 
-Plang::AnyRef Plang::Function::Call(const Plang::Tuple& Arguments, const Plang::AnyRef& localScope)
+Plang::Value Plang::Function::Call(const Plang::Tuple& Arguments, const Plang::AnyRef& localScope)
 {
     auto scope = signature.Parse(Arguments);
 	scope.prototype = localScope;
@@ -234,14 +453,30 @@ struct ScriptFrame
     size_t index; //index of current instruction
 };
 
-Plang::AnyRef Plang::Script::Evaluate(const Plang::Tuple& arguments, const AnyRef& parentScope)
-{
-    std::vector<AnyRef> registers; //holds intermediate values for functions
-    std::stack<AnyRef> dot; //object scopes
+Plang::Script::EvaluationMode Plang::Script::evaluationMode = Plang::Script::EvaluationMode::Bytecode;
 
-   auto localScope(std::make_shared<Construct>(signature.Parse(arguments)));
+Plang::Value Plang::Script::Evaluate(const Plang::Tuple& arguments, const AnyRef& parentScope)
+{
+   auto localScope(Heap::New<Construct>(signature.Parse(arguments)));
    localScope->prototype = parentScope;
 
+    if (evaluationMode == EvaluationMode::Bytecode)
+    {
+        if (code == nullptr)
+            code = std::make_shared<Bytecode>(instructions);
+        return code->Run(localScope, owner);
+    }
+
+    if (instructions.type == InstructionType::Deferred)
+        instructions = Parser::ParseDeferred(instructions, owner);
+    return EvaluateTree(localScope);
+}
+
+Plang::Value Plang::Script::EvaluateTree(const AnyRef& localScope)
+{
+    std::vector<Value> registers; //holds intermediate values for functions
+    std::stack<AnyRef> dot; //object scopes
+
     std::stack<ScriptFrame> stack;
     stack.push({ instructions, 0 });
 
@@ -258,20 +493,28 @@ Plang::AnyRef Plang::Script::Evaluate(const Plang::Tuple& arguments, const AnyRe
                 auto& list(top.instruction.As<Instructions::List>());
                 assert(list.Count() > 0);
 
-                AnyRef next = list[0].type == InstructionType::Unknown
+                Value next = list[0].type == InstructionType::Unknown
                     ? Undefined /*todo*/ :
                     localScope->Get(list[0]);
                 for (size_t i = 1; i < list.Count(); ++i)
                 {
-                    if (next == nullptr)
+                    if (next.IsUndefined())
                         throw (std::string)list[i - 1] + "is undefined";
 
-                    next = next->Get(std::get<std::string>(list[i].value));
+                    next = next.Get(std::string(std::get<TString>(list[i].value)));
                 }
                 registers.push_back(next);
                 stack.pop();
                 continue;
             }
+            else if (top.instruction.type == InstructionType::Expression)
+            {
+                //the body is not evaluated (or parsed, if deferred) until the script is called
+                auto& expression(top.instruction.As<Instructions::Expression>());
+                registers.push_back(Heap::New<Script>(expression.Body(), owner));
+                stack.pop();
+                continue;
+            }
             else if (top.index < children->size())
             {
                 stack.push({ children->at(top.index), 0 });
@@ -283,22 +526,22 @@ Plang::AnyRef Plang::Script::Evaluate(const Plang::Tuple& arguments, const AnyRe
         switch (top.instruction.type)
         {
         case InstructionType::Int:
-            registers.push_back(std::make_shared<Plang::Int>(top.instruction.value));
+            registers.push_back(std::get<TInt>(top.instruction.value));
             break;
         case InstructionType::Float:
-            registers.push_back(std::make_shared<Plang::Float>(top.instruction.value));
+            registers.push_back(std::get<TFloat>(top.instruction.value));
             break;
         case InstructionType::String:
-            registers.push_back(std::make_shared<Plang::String>(top.instruction.value));
+            registers.push_back(Heap::New<Plang::String>(top.instruction.value));
             break;
         case InstructionType::Identifier:
-            registers.push_back(localScope->Get(std::get<std::string>(top.instruction.value)));
+            registers.push_back(localScope->Get(std::string(std::get<TString>(top.instruction.value))));
             break;
 
         case InstructionType::List:
         {
             auto count(top.instruction.As<Instructions::List>().Count());
-            auto list(std::make_shared<List>());
+            auto list(Heap::New<List>());
             list->value.assign(registers.end() - count, registers.end()); //todo: revisit
             registers.resize(registers.size() - count);
             registers.push_back(list);
@@ -310,19 +553,23 @@ Plang::AnyRef Plang::Script::Evaluate(const Plang::Tuple& arguments, const AnyRe
             auto nArgs(fn.Arguments().Count());
             auto& id(registers[registers.size() - nArgs - 1]);
 
-            if (id == Undefined)
-                throw "Undefined (" + (std::string)fn.Callee() + ") is not a function";
-
             //assert(args->Type() == ConstructType::Tuple);
             //auto& argsTup(*std::static_pointer_cast<Tuple>(args));
 
-            Tuple args(registers.end() - nArgs, registers.end());
+            Tuple args(registers.data() + registers.size() - nArgs, registers.data() + registers.size());
 
-            AnyRef rval;
-            if (id->Type() == ConstructType::Function)
-                rval = std::static_pointer_cast<Function>(id)->Call(args, localScope);
-            else if (id->Type() == ConstructType::Script)
-                rval = std::static_pointer_cast<Script>(id)->Evaluate(args, localScope);
+            Value rval;
+            if (id.IsUndefined())
+            {
+                //operators that are not defined in scope fall back to the built in operators
+                rval = Builtins::Call(top.instruction, args);
+                if (rval.IsUndefined())
+                    throw "Undefined (" + (std::string)fn.Callee() + ") is not a function";
+            }
+            else if (id.Type() == ConstructType::Function)
+                rval = id.As<Function>().Call(args, localScope);
+            else if (id.Type() == ConstructType::Script)
+                rval = id.As<Script>().Evaluate(args, localScope);
             else
                 throw (std::string)fn.Callee() + " is not a function";
 
@@ -333,6 +580,9 @@ Plang::AnyRef Plang::Script::Evaluate(const Plang::Tuple& arguments, const AnyRe
         case InstructionType::Unknown:
             registers.push_back(Undefined);
             break;
+        case InstructionType::Deferred:
+            //bodies are only deferred inside expressions, which are parsed when their script is evaluated (see Evaluate)
+            throw "Deferred body was not parsed before evaluation @ " + (std::string)top.instruction.location;
         }
 
         stack.pop();
@@ -340,7 +590,7 @@ Plang::AnyRef Plang::Script::Evaluate(const Plang::Tuple& arguments, const AnyRe
 
     //return value of statement
     if (registers.size() > 1)
-        throw "???";
+        throw "Script left " + std::to_string(registers.size()) + " values @ " + (std::string)instructions.location;
 
     return registers.empty() ? Undefined : registers[0]; //todo: handle returning self in bound methods (?)
 }
\ No newline at end of file
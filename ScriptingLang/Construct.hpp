@@ -3,14 +3,15 @@
 #include "pch.hpp"
 #include "Array.hpp"
 #include "Instruction.hpp"
+#include "Shape.hpp"
+#include "Value.hpp"
+#include "Heap.hpp"
 
 namespace Plang
 {
     class Construct;
-    template <class T>
-    using Reference = std::shared_ptr<T>;
-    using AnyRef = Reference<Construct>;
-    extern AnyRef Undefined;
+    class Bytecode;
+    class PropertyCache;
 
 	enum class ConstructType
 	{
@@ -26,54 +27,133 @@ namespace Plang
 
 	std::string TypeToString(const ConstructType& Type);
 
-	//The basic object type. Everything is a construct from literals to lexical blocks to functions to scopes
-	class Construct
+	//The basic object type. Everything is a construct from literals to lexical blocks to functions to scopes.
+	//Constructs referenced by scripts are created with Heap::New
+	class Construct : public Counted
 	{
-		using PropMap = std::map<std::string, AnyRef>;
-
 	public:
+		//Iterates over the properties in the order they were added
+		template <class TConstruct, class TValue>
+		class PropertyIterator
+		{
+		public:
+			PropertyIterator(TConstruct* construct, size_t slot) : construct(construct), slot(slot) { }
+
+			inline std::pair<const std::string&, TValue&> operator *() const { return { construct->SlotName(slot), construct->slots[slot] }; }
+			inline PropertyIterator& operator ++() { ++slot; return *this; }
+			inline bool operator == (const PropertyIterator& other) const { return slot == other.slot; }
+			inline bool operator != (const PropertyIterator& other) const { return slot != other.slot; }
+
+		private:
+			TConstruct* construct;
+			size_t slot;
+		};
+		using iterator = PropertyIterator<Construct, Value>;
+		using const_iterator = PropertyIterator<const Construct, const Value>;
+
         Construct(const AnyRef& prototype = nullptr) : prototype(prototype) { }
-        Construct(const ::Array<std::pair<std::string, AnyRef>>& defaults) : properties(&defaults[0], &defaults[0] + defaults.Length()) { }
-		virtual ~Construct() = default;
+        Construct(const ::Array<std::pair<std::string, Value>>& defaults);
+		Construct(const Construct& other);
+		Construct(Construct&& other) = default;
+		Construct& operator = (const Construct& other);
+		Construct& operator = (Construct&& other) = default;
+		virtual ~Construct() { if (heapEntry.tracked) Heap::Untrack(*this); }
+
+		//constructs are always allocated from the heap's arenas
+		static void* operator new(size_t size) { return Heap::Allocate(size); }
+		static void operator delete(void* memory, size_t size) { Heap::Free(memory, size); }
 
 		virtual inline ConstructType Type() const { return ConstructType::Construct; }
 		virtual std::string ToString() const; //basic value output. Constructs may have custom as operator which has a string conversion
 
-		AnyRef&       Set(const std::string& name, const AnyRef& ref, bool searchInParents = false); //If searchInParents is true, property is set where it is defined or in this scope if not found
-		AnyRef&       Get(const std::string& name, bool searchInParents = true);
-		const AnyRef& Get(const std::string& name, bool searchInParents = true) const;
+		Value&        Set(const std::string& name, const Value& value, bool searchInParents = false); //If searchInParents is true, property is set where it is defined or in this scope if not found. Shared type prototypes are never searched
+		Value&        Get(const std::string& name, bool searchInParents = true);
+		const Value&  Get(const std::string& name, bool searchInParents = true) const;
 		bool          Has(const std::string& name, bool searchInParents = true) const;
 		bool          Remove(const std::string& name);
-		inline size_t Count() const { return properties.size(); } //The number of defined properties in this construct
+		inline size_t Count() const { return slots.Count(); } //The number of defined properties in this construct
 
 		//iterators (For public properties)
-		inline PropMap::iterator begin() { return properties.begin(); }
-		inline PropMap::iterator end() { return properties.end(); }
-		inline PropMap::const_iterator begin() const { return properties.begin(); }
-		inline PropMap::const_iterator end() const { return properties.end(); }
-		inline PropMap::const_iterator cbegin() const { return properties.cbegin(); }
-		inline PropMap::const_iterator cend() const { return properties.cend(); }
+		inline iterator begin() { return iterator(this, 0); }
+		inline iterator end() { return iterator(this, Count()); }
+		inline const_iterator begin() const { return const_iterator(this, 0); }
+		inline const_iterator end() const { return const_iterator(this, Count()); }
+		inline const_iterator cbegin() const { return begin(); }
+		inline const_iterator cend() const { return end(); }
 
 		//Merge another construct's properties into this one (does not modify prototype or copy inherited properties). Returns a reference to this construct
 		Construct& Merge(const Construct& Other, bool Overwrite = true);
 
+		//Frozen constructs are shared literals (see Bytecode::constants) and throw if their properties are changed. Use Value::Modify to change a copy
+		inline void Freeze() { frozen = true; }
+		inline bool IsFrozen() const { return frozen; }
+
         AnyRef prototype;
 
+		//Used by the collector: visit each construct this holds a reference to, or move those references out (to free a cycle)
+		virtual void Trace(const std::function<void(Construct&)>& Visit) const;
+		virtual void Release(std::vector<Value>& Released);
+
 	protected:
-		PropMap properties; //the public property scope. Inherits from accessor that calls this. Created on call (or instantiation)
+		friend class PropertyCache;
+		friend class Heap;
+
+		//Property values by slot. The first few are stored in the construct, the rest in a vector
+		class Slots
+		{
+		public:
+			static constexpr size_t InlineCount = 2;
+
+			inline Value& operator [](size_t slot) { return slot < InlineCount ? first[slot] : rest[slot - InlineCount]; }
+			inline const Value& operator [](size_t slot) const { return slot < InlineCount ? first[slot] : rest[slot - InlineCount]; }
+			inline size_t Count() const { return count; }
+
+			void Add(const Value& value);
+			void Remove(size_t slot); //later values move down a slot
+
+		private:
+			Value first[InlineCount];
+			std::vector<Value> rest;
+			size_t count = 0;
+		};
+
+		//Properties of constructs that have too many (or have removed many) are looked up in a table instead of a shared shape
+		struct Dictionary
+		{
+			std::unordered_map<std::string, uint32_t> slots;
+			std::vector<std::string> names; //by slot
+		};
+		static constexpr size_t MaxRemovals = 4; //constructs that remove more properties than this switch to dictionary mode
+
+		Shape::Ref shape = Shape::Empty(); //null in dictionary mode
+		std::unique_ptr<Dictionary> dictionary;
+		Slots slots;
+		uint32_t removals = 0;
+		bool shared = false; //the prototype of a primitive type. Properties are not set in it through the constructs that inherit it
+		bool frozen = false; //not copied
+		Heap::Entry heapEntry;
+
+		uint32_t FindSlot(std::string_view name) const; //Shape::NotFound if not defined in this construct
+		const std::string& SlotName(size_t slot) const;
+		Value& AddProperty(const std::string& name, const Value& value);
+		void RemoveProperty(size_t slot);
+		void UseDictionary();
+
+		static const AnyRef& Share(const AnyRef& prototype); //mark a primitive type's prototype as shared
 	};
 
-	//Null and Undefined are special references
+	//Numbers are normally stored in values. These box them when they are used as constructs.
+	//Each primitive type's builtin properties live in one prototype shared by every construct (and number value) of that type
 
 	class Int : public Construct
 	{
 	public:
 		using ValueType = TInt;
 
-		Int() : value(0) { Merge(Prototype); }
-		Int(const ValueType& value) : value(value) { Merge(Prototype); }
+		Int() : Construct(Prototype()), value(0) { }
+		Int(const ValueType& value) : Construct(Prototype()), value(value) { }
         Int(const Instruction::ValueType& value)
-            : value(std::get<TInt>(value)) { Merge(Prototype); }
+            : Construct(Prototype()), value(std::get<TInt>(value)) { }
 
 		inline ConstructType Type() const override { return ConstructType::Int; }
 		inline std::string ToString() const override { return std::to_string(value); }
@@ -81,7 +161,7 @@ namespace Plang
 
 		ValueType value;
 
-        static Construct Prototype;
+        static const AnyRef& Prototype(); //the properties shared by all ints
 	};
 
 	class Float : public Construct
@@ -89,16 +169,18 @@ namespace Plang
 	public:
 		using ValueType = TFloat;
 
-        Float() : value(0.0f) { }
-		Float(const ValueType& value) : value(value) { }
+        Float() : Construct(Prototype()), value(0.0f) { }
+		Float(const ValueType& value) : Construct(Prototype()), value(value) { }
         Float(const Instruction::ValueType& value)
-            : value(std::get<TFloat>(value)) { }
+            : Construct(Prototype()), value(std::get<TFloat>(value)) { }
 
 		inline ConstructType Type() const override { return ConstructType::Float; }
 		inline std::string ToString() const override { return std::to_string(value); }
 		inline std::string ToString(int Radix) const { return std::to_string(value); }
 
 		ValueType value;
+
+        static const AnyRef& Prototype(); //the properties shared by all floats
 	};
 
 	class String : public Construct
@@ -106,25 +188,27 @@ namespace Plang
 	public:
 		using ValueType = std::string;
 
-		String() : value("") { }
-		String(const ValueType& value) : value(value) { }
-		String(const ValueType::value_type* value) : value(value) { }
+		String() : Construct(Prototype()), value("") { }
+		String(const ValueType& value) : Construct(Prototype()), value(value) { }
+		String(const ValueType::value_type* value) : Construct(Prototype()), value(value) { }
         String(const Instruction::ValueType& value)
-            : value(std::get<std::string>(value)) { }
+            : Construct(Prototype()), value(std::get<TString>(value)) { }
 
 		inline ConstructType Type() const override { return ConstructType::String; }
 		inline std::string ToString() const override { return "'" + value + "'"; }
 
 		ValueType value;
+
+        static const AnyRef& Prototype(); //the properties shared by all strings
 	};
 
     struct Tuple
     {
-        using Iterator = std::vector<AnyRef>::const_iterator;
+        using Iterator = const Value*;
         Tuple() { }
         Tuple(const Iterator& begin, const Iterator& end) : begin(begin), end(end) { }
 
-        Iterator begin, end;
+        Iterator begin = nullptr, end = nullptr;
 
         size_t Length() const { return std::distance(begin, end); }
 
@@ -134,7 +218,7 @@ namespace Plang
             return Tuple(begin + start, begin + start + count);
         }
 
-        const AnyRef& operator[](size_t index) const
+        const Value& operator[](size_t index) const
         {
             return *(begin + index);
         }
@@ -154,7 +238,7 @@ namespace Plang
 			std::string s = "[|";
 			for (size_t i = 0; i < value.Length(); i++)
 			{
-				s += value[i]->ToString();
+				s += value[i].ToString();
 				if (i < value.Length() - 1)
 					s += ",";
 			}
@@ -173,10 +257,10 @@ namespace Plang
 	class List : public Construct
 	{
 	public:
-		List() = default;
-		List(const std::vector<AnyRef>& values) : value(values) { }
-        List(const ::Array<AnyRef>& array) : value(array.Data(), array.Data() + array.Length()) { }
-        List(const Tuple& tuple) : value(tuple.begin, tuple.end) { }
+		List() : Construct(Prototype()) { }
+		List(const std::vector<Value>& values) : Construct(Prototype()), value(values) { }
+        List(const ::Array<Value>& array) : Construct(Prototype()), value(array.Data(), array.Data() + array.Length()) { }
+        List(const Tuple& tuple) : Construct(Prototype()), value(tuple.begin, tuple.end) { }
 
 		inline ConstructType Type() const override { return ConstructType::List; }
 		inline std::string ToString() const override
@@ -184,7 +268,7 @@ namespace Plang
 			std::string s = "[";
 			for (size_t i = 0; i < value.size(); i++)
 			{
-				s += value[i]->ToString();
+				s += value[i].ToString();
 				if (i < value.size() - 1)
 					s += ",";
 			}
@@ -192,14 +276,19 @@ namespace Plang
 			return s;
 		}
 
-		inline AnyRef& Add(const AnyRef& Ref) { value.push_back(Ref); return value.back(); }
-		inline AnyRef Remove(const AnyRef& Ref) { AnyRef rval = value.back(); value.pop_back(); return rval; }
+		inline Value& Add(const Value& Ref) { value.push_back(Ref); return value.back(); }
+		inline Value Remove(const Value& Ref) { Value rval = value.back(); value.pop_back(); return rval; }
 
-		inline AnyRef& operator[](size_t Index) { return value[Index]; }
-		inline const AnyRef& operator[](size_t Index) const { return value[Index]; }
+		inline Value& operator[](size_t Index) { return value[Index]; }
+		inline const Value& operator[](size_t Index) const { return value[Index]; }
 		inline const size_t Length() const { return value.size(); }
 
-		std::vector<AnyRef> value;
+		std::vector<Value> value;
+
+        static const AnyRef& Prototype(); //the properties shared by all lists
+
+		void Trace(const std::function<void(Construct&)>& Visit) const override;
+		void Release(std::vector<Value>& Released) override;
 	};
 
 	enum class ArgumentType
@@ -239,7 +328,7 @@ namespace Plang
 	class Function : public Construct
 	{
 	public:
-		using TFunction = std::function<AnyRef(Construct& Scope)>;
+		using TFunction = std::function<Value(Construct& Scope)>;
 
 		inline Function(const Signature& signature, const TFunction& callable)
 			: signature(signature), function(callable) { }
@@ -249,33 +338,36 @@ namespace Plang
 		inline ConstructType Type() const override { return ConstructType::Function; }
 		inline std::string ToString() const override { return "[[ Native function ]]"; } //todo: base 16
 
-		AnyRef Call(const Tuple& Arguments, const AnyRef& LexScope = Undefined); //raw construct?
-		inline AnyRef Call(const AnyRef& LexScope = Undefined)
+		Value Call(const Tuple& Arguments, const AnyRef& LexScope = nullptr); //raw construct?
+		inline Value Call(const AnyRef& LexScope = nullptr)
 		{
 			Tuple args;
 			return Call(args, LexScope);
 		}
 
 		Signature signature;
-		TFunction function;
+		TFunction function; //references held by the function are not traced, so are always treated as reachable
         AnyRef boundScope; //todo
+
+		void Trace(const std::function<void(Construct&)>& Visit) const override;
+		void Release(std::vector<Value>& Released) override;
 	};
 
 	//A parsed script. All scripts behave like functions, having arguments and a return value
 	class Script : public Construct
 	{
 	public:
-		Script(const Signature& signature, const Instruction& rootInstruction)
-			: signature(signature), instructions(rootInstruction) { }
-		Script(const Instruction& rootInstruction)
-			: instructions(rootInstruction)  { }
+		Script(const Signature& signature, const Instruction& rootInstruction, std::shared_ptr<const void> owner = nullptr)
+			: signature(signature), instructions(rootInstruction), owner(std::move(owner)) { }
+		Script(const Instruction& rootInstruction, std::shared_ptr<const void> owner = nullptr)
+			: instructions(rootInstruction), owner(std::move(owner)) { }
 
 		inline ConstructType Type() const override { return ConstructType::Script; }
 		inline std::string ToString() const override { return "[[ Script (" + instructions.TypeName() + ") ]]"; } //todo: print signature
 
-		AnyRef Evaluate(const Tuple& arguments, const AnyRef& lexScope = Undefined);
+		Value Evaluate(const Tuple& arguments, const AnyRef& lexScope = nullptr);
         //todo: limited evaluation (N instructions, returns task/etc)
-		inline AnyRef Evaluate(const AnyRef& lexScope = Undefined)
+		inline Value Evaluate(const AnyRef& lexScope = nullptr)
 		{
 			Tuple args;
 			return Evaluate(args, lexScope);
@@ -283,11 +375,33 @@ namespace Plang
 
 		Signature signature;
 		Instruction instructions;
+		std::shared_ptr<const void> owner; //keeps the instructions alive, e.g. the parser's arena or a loaded cache (if not owned elsewhere)
+        std::shared_ptr<Bytecode> code; //compiled from the instructions when first evaluated (may be shared by scripts of the same expression)
         AnyRef boundScope; //todo
 
+		void Trace(const std::function<void(Construct&)>& Visit) const override;
+		void Release(std::vector<Value>& Released) override;
+
+        //Scripts are compiled to bytecode by default. Tree evaluates the instructions directly, and is kept as a reference for testing
+        enum class EvaluationMode
+        {
+            Bytecode,
+            Tree
+        };
+        static EvaluationMode evaluationMode;
+
     protected:
+        Value EvaluateTree(const AnyRef& localScope);
 	};
 
+    template <class T>
+    T& Value::Modify()
+    {
+        if (As<Construct>().IsFrozen())
+            *this = Heap::New<T>(As<T>());
+        return As<T>();
+    }
+
     std::ostream& operator << (std::ostream& Stream, const Plang::Construct& Construct);
     std::ostream& operator << (std::ostream& Stream, const Plang::AnyRef& Ref);
 };
\ No newline at end of file
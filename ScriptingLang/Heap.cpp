@@ -0,0 +1,245 @@
+#include "pch.hpp"
+#include "Heap.hpp"
+#include "Construct.hpp"
+#ifdef PLANG_ATOMIC_REFERENCES
+#include <mutex>
+#endif
+
+using namespace Plang;
+
+namespace
+{
+    struct Generation
+    {
+        Construct* first;
+        size_t count;
+    };
+
+    constexpr size_t SizeClassCount = Heap::MaxBlockSize / Heap::Granularity;
+
+    //only plain data, so that it can still be used by constructs destroyed after it during exit. Arena chunks are never released
+    struct State
+    {
+        void* free[SizeClassCount]; //each free block holds the next
+        char* next; //the unused part of the last chunk
+        char* limit;
+        Generation generations[Heap::GenerationCount];
+        size_t youngCollections; //since the last full collection
+        size_t oldAfterFull; //the size of the old generation after the last full collection
+        size_t collections;
+        size_t collected;
+        size_t reserved;
+    };
+    State state;
+
+#ifdef PLANG_ATOMIC_REFERENCES
+    //constructs shared between threads may be released on any of them. Never destroyed (see State)
+    std::recursive_mutex& Mutex()
+    {
+        static auto mutex = new std::recursive_mutex;
+        return *mutex;
+    }
+#define LOCK_HEAP() std::lock_guard<std::recursive_mutex> lock(Mutex())
+#else
+#define LOCK_HEAP()
+#endif
+}
+
+#ifdef PLANG_ATOMIC_REFERENCES
+size_t Heap::threshold = 0; //other threads may be using the constructs a collection would trace
+#else
+size_t Heap::threshold = 1000;
+#endif
+
+void* Heap::Allocate(size_t Size)
+{
+    if (Size > MaxBlockSize)
+        return ::operator new(Size);
+
+    LOCK_HEAP();
+
+    auto sizeClass = (Size != 0 ? (Size - 1) / Granularity : 0);
+    if (auto block = state.free[sizeClass])
+    {
+        state.free[sizeClass] = *static_cast<void**>(block);
+        return block;
+    }
+
+    auto blockSize = (sizeClass + 1) * Granularity;
+    if ((size_t)(state.limit - state.next) < blockSize)
+    {
+        state.next = static_cast<char*>(::operator new(ChunkSize));
+        state.limit = state.next + ChunkSize;
+        state.reserved += ChunkSize;
+    }
+    auto block = state.next;
+    state.next += blockSize;
+    return block;
+}
+
+void Heap::Free(void* Memory, size_t Size)
+{
+    if (Size > MaxBlockSize)
+    {
+        ::operator delete(Memory);
+        return;
+    }
+
+    LOCK_HEAP();
+
+    auto sizeClass = (Size != 0 ? (Size - 1) / Granularity : 0);
+    *static_cast<void**>(Memory) = state.free[sizeClass];
+    state.free[sizeClass] = Memory;
+}
+
+void Heap::Track(Construct& Construct)
+{
+    LOCK_HEAP();
+    auto& entry = Construct.heapEntry;
+    auto& young = state.generations[0];
+    entry.tracked = true;
+    entry.generation = 0;
+    entry.next = young.first;
+    if (young.first != nullptr)
+        young.first->heapEntry.previous = &Construct;
+    young.first = &Construct;
+    ++young.count;
+
+    //the old generation is only collected when it has grown by a quarter, so that large live heaps are not traced repeatedly
+    if (threshold != 0 && young.count > threshold)
+    {
+        auto oldCount = state.generations[1].count;
+        Collect(++state.youngCollections >= FullCollectionInterval && oldCount > state.oldAfterFull + state.oldAfterFull / 4);
+    }
+}
+
+void Heap::Untrack(Construct& Construct)
+{
+    LOCK_HEAP();
+    auto& entry = Construct.heapEntry;
+    auto& generation = state.generations[entry.generation];
+    if (entry.previous != nullptr)
+        entry.previous->heapEntry.next = entry.next;
+    else
+        generation.first = entry.next;
+    if (entry.next != nullptr)
+        entry.next->heapEntry.previous = entry.previous;
+    --generation.count;
+    entry.tracked = false;
+}
+
+size_t Heap::Collect(bool Full)
+{
+    LOCK_HEAP();
+    auto collectedGenerations = (Full ? GenerationCount : 1);
+    auto isCollected = [&](const Construct& Construct)
+    {
+        return Construct.heapEntry.tracked && Construct.heapEntry.generation < collectedGenerations;
+    };
+
+    //count the references to each construct from outside the collected constructs
+    for (size_t g = 0; g < collectedGenerations; ++g)
+    {
+        for (auto construct = state.generations[g].first; construct != nullptr; construct = construct->heapEntry.next)
+        {
+            construct->heapEntry.references = construct->References();
+            construct->heapEntry.reachable = false;
+        }
+    }
+    for (size_t g = 0; g < collectedGenerations; ++g)
+    {
+        for (auto construct = state.generations[g].first; construct != nullptr; construct = construct->heapEntry.next)
+        {
+            construct->Trace([&](Plang::Construct& referent)
+            {
+                if (isCollected(referent))
+                    --referent.heapEntry.references;
+            });
+        }
+    }
+
+    //mark everything reachable from those referenced from outside
+    std::vector<Construct*> stack;
+    for (size_t g = 0; g < collectedGenerations; ++g)
+    {
+        for (auto construct = state.generations[g].first; construct != nullptr; construct = construct->heapEntry.next)
+        {
+            if (construct->heapEntry.references > 0)
+            {
+                construct->heapEntry.reachable = true;
+                stack.push_back(construct);
+            }
+        }
+    }
+    while (!stack.empty())
+    {
+        auto construct = stack.back();
+        stack.pop_back();
+        construct->Trace([&](Plang::Construct& referent)
+        {
+            if (isCollected(referent) && !referent.heapEntry.reachable)
+            {
+                referent.heapEntry.reachable = true;
+                stack.push_back(&referent);
+            }
+        });
+    }
+
+    //the rest are only referenced by each other. Their references are moved out (while they are kept alive) to break the cycles
+    std::vector<AnyRef> garbage;
+    for (size_t g = 0; g < collectedGenerations; ++g)
+    {
+        for (auto construct = state.generations[g].first; construct != nullptr; construct = construct->heapEntry.next)
+        {
+            if (!construct->heapEntry.reachable)
+                garbage.emplace_back(construct);
+        }
+    }
+    std::vector<Value> released;
+    for (auto& construct : garbage)
+        construct->Release(released);
+    released.clear();
+    auto count = garbage.size();
+    garbage.clear();
+
+    //the survivors are now old
+    auto& young = state.generations[0];
+    auto& old = state.generations[1];
+    if (young.first != nullptr)
+    {
+        auto last = young.first;
+        for (;; last = last->heapEntry.next)
+        {
+            last->heapEntry.generation = 1;
+            if (last->heapEntry.next == nullptr)
+                break;
+        }
+        last->heapEntry.next = old.first;
+        if (old.first != nullptr)
+            old.first->heapEntry.previous = last;
+        old.first = young.first;
+        old.count += young.count;
+        young = { nullptr, 0 };
+    }
+
+    if (Full)
+    {
+        state.youngCollections = 0;
+        state.oldAfterFull = old.count;
+    }
+    ++state.collections;
+    state.collected += count;
+    return count;
+}
+
+Heap::Statistics Heap::Stats()
+{
+    LOCK_HEAP();
+    Statistics stats;
+    stats.collections = state.collections;
+    stats.collected = state.collected;
+    for (auto& generation : state.generations)
+        stats.live += generation.count;
+    stats.reserved = state.reserved;
+    return stats;
+}
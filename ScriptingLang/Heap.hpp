@@ -0,0 +1,73 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Value.hpp"
+
+namespace Plang
+{
+    //Allocates constructs from arenas of fixed size blocks (one free list per size class), and tracks those created with New.
+    //Reference counting frees most constructs as soon as they are unused. The cycles it cannot free are found by a tracing collector
+    //that runs every few allocations. Its roots are the constructs referenced from outside the collected ones (registers, scopes on
+    //the native stack, global scopes, compiled scripts): what is left of their reference counts after subtracting the references
+    //between collected constructs, so the stack does not need to be scanned.
+    //New constructs are collected on their own (the young generation) until they survive a collection and become old.
+    //Like the rest of the runtime, this is single-threaded unless built with PLANG_ATOMIC_REFERENCES (see Reference.hpp), which locks
+    //the heap so that constructs can be released on any thread. Collections are then only run by calling Collect, when no other thread is using constructs
+    class Heap
+    {
+    public:
+        static constexpr size_t Granularity = 16; //the difference between size classes (and their alignment)
+        static constexpr size_t MaxBlockSize = 512; //larger allocations use the global allocator
+        static constexpr size_t ChunkSize = 64 * 1024; //arenas are allocated in chunks of this size
+        static constexpr size_t GenerationCount = 2;
+        static constexpr size_t FullCollectionInterval = 10; //the minimum number of young collections between each collection of the old generation
+
+        //The collector's bookkeeping, stored in each construct. Not copied with the construct
+        struct Entry
+        {
+            Entry() = default;
+            Entry(const Entry&) { }
+            Entry& operator = (const Entry&) { return *this; }
+
+            Construct* previous = nullptr;
+            Construct* next = nullptr;
+            uint32_t references = 0; //while collecting, the number of references from outside the collected constructs
+            uint8_t generation = 0;
+            bool tracked = false; //whether created with New
+            bool reachable = false;
+        };
+
+        //Create a construct owned by the heap
+        template <class T, class... TArgs>
+        static Reference<T> New(TArgs&&... Args)
+        {
+            static_assert(alignof(T) <= Granularity, "Heap blocks are not aligned enough");
+            Reference<T> construct(new T(std::forward<TArgs>(Args)...));
+            Track(*construct);
+            return construct;
+        }
+
+        static void* Allocate(size_t Size);
+        static void Free(void* Memory, size_t Size);
+
+        //Free the unreachable constructs in the young generation (or every generation, if Full). Returns the number freed
+        static size_t Collect(bool Full = true);
+
+        static size_t threshold; //the number of new constructs in the young generation that starts a collection (0 to only collect when Collect is called, the default with atomic references)
+
+        struct Statistics
+        {
+            size_t collections = 0;
+            size_t collected = 0; //constructs freed by the collector
+            size_t live = 0; //constructs created with New that have not been freed
+            size_t reserved = 0; //bytes allocated for arenas
+        };
+        static Statistics Stats();
+
+    protected:
+        friend class Construct;
+
+        static void Track(Construct& Construct);
+        static void Untrack(Construct& Construct); //when destroyed
+    };
+};
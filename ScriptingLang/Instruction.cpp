@@ -19,7 +19,9 @@ static std::string instructionTypeStrings[] =
     "Tuple",
 
     "Call",
-    "Expression"
+    "Expression",
+
+    "Deferred"
 };
 
 //get the length of the type name of the longest child of a node. Used for column alignment
@@ -39,16 +41,21 @@ std::string Plang::Instruction::TypeName() const
     return instructionTypeStrings[(size_t)type];
 }
 
+std::string Plang::Instruction::TypeName(InstructionType Type)
+{
+    return instructionTypeStrings[(size_t)Type];
+}
+
 Plang::Instruction::operator std::string() const
 {
     //todo: use visitors
     if (auto pval = std::get_if<nullptr_t>(&value))
         return "[null]";
-    if (auto pval = std::get_if<std::string>(&value))
+    if (auto pval = std::get_if<TString>(&value))
     {
         if (type == InstructionType::Identifier)
-            return *pval;
-        return '"' + *pval + '"';
+            return std::string(*pval);
+        return '"' + std::string(*pval) + '"';
     }
     if (auto pval = std::get_if<TInt>(&value))
         return std::to_string(*pval);
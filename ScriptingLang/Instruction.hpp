@@ -2,52 +2,11 @@
 
 #include "pch.hpp"
 #include "Location.hpp"
+#include "Arena.hpp"
+#include "Symbol.hpp"
 
 namespace Plang
 {
-    //necessary?
-    template <typename T>
-    class NonOwningRef
-    {
-    public:
-        NonOwningRef() : ptr(nullptr) { }
-        NonOwningRef(T& value) : ptr(&value) { }
-        NonOwningRef(T* value) : ptr(value) { }
-        ~NonOwningRef() { }
-
-        inline T* operator ->() { return ptr; }
-        inline T& operator *() { return *ptr; }
-        inline T& operator *() const { return *ptr; }
-
-        inline bool operator ==(std::nullptr_t null) const
-        {
-            return ptr == null;
-        }
-        inline bool operator ==(const T& other) const //reference compare
-        {
-            return ptr == &other;
-        }
-        inline bool operator ==(T* other) const //reference compare
-        {
-            return ptr == other;
-        }
-        inline bool operator !=(std::nullptr_t null) const
-        {
-            return ptr != null;
-        }
-        inline bool operator !=(const T& other) const //reference compare
-        {
-            return ptr != &other;
-        }
-        inline bool operator !=(T* other) const //reference compare
-        {
-            return ptr != other;
-        }
-
-    protected:
-        T* ptr;
-    };
-
     enum class InstructionType
     {
         Unknown,
@@ -66,7 +25,9 @@ namespace Plang
         Tuple,
 
         Call,
-        Expression
+        Expression,
+
+        Deferred //an expression body that has not been parsed yet (see Parser::ParseDeferred). The value is the offset of its closing bracket, with the module's revision in the high 32 bits
     };
 
     class Instruction;
@@ -74,28 +35,29 @@ namespace Plang
 
     using TInt = int64_t;
     using TFloat = double;
-    using TList = std::vector<Instruction>;
+    using TString = std::string_view;
+    using TList = Span<Instruction>;
 
     //instructions created for storage in the AST.
     //These are used by the runtime, but should be static after parsing
+    //Instructions are allocated in an arena (see Parser) and are never destructed, so strings and children are views of arena memory
     class Instruction
     {
     public:
 
-        using ValueType = std::variant<std::nullptr_t, TInt, TFloat, std::string, TList>;
+        using ValueType = std::variant<std::nullptr_t, TInt, TFloat, TString, TList>;
 
         Instruction() = default;
         Instruction(InstructionType type) : type(type) { }
-        Instruction(InstructionType type, const ValueType& value) : type(type), value(value) { }
-
-        virtual ~Instruction() = default;
+        Instruction(InstructionType type, const ValueType& value) : value(value), type(type) { }
 
         Location location;
-        NonOwningRef<Instruction> parent; //nullptr if root instruction
         ValueType value;
         InstructionType type;
+        SymbolId symbol = NoSymbol; //the interned name of identifiers
 
         std::string TypeName() const;
+        static std::string TypeName(InstructionType Type);
 
         template <class TFacade>
         std::enable_if_t<std::is_convertible_v<TFacade, InstructionFacade>, TFacade>& As()
@@ -118,40 +80,11 @@ namespace Plang
         class List : public InstructionFacade
         {
         public:
-            inline Instruction& operator [](size_t index)
+            inline Instruction& operator [](size_t index) const
             {
                 auto& items = std::get<TList>(value);
                 return items.at(index);
             }
-            inline Instruction operator [](size_t index) const
-            {
-                return operator[](index);
-            }
-
-            inline Instruction& Add(const Instruction& instruction)
-            {
-                auto& items = std::get<TList>(value);
-                items.push_back(instruction);
-                return items.back();
-            }
-            inline Instruction& Insert(const Instruction& instruction, size_t index = 0)
-            {
-                auto& items = std::get<TList>(value);
-                return *items.insert(items.begin() + index, instruction);
-            }
-            inline bool Remove(const Instruction& instruction)
-            {
-                auto& items = std::get<TList>(value);
-                for (auto i = items.begin(); i != items.end(); ++i)
-                {
-                    if (&*i == &instruction)
-                    {
-                        items.erase(i);
-                        return true;
-                    }
-                }
-                return false;
-            }
 
             inline size_t Count() const
             {
@@ -159,13 +92,13 @@ namespace Plang
                 return items.size();
             }
 
-            inline Instruction& First()
+            inline Instruction& First() const
             {
                 auto& items = std::get<TList>(value);
                 return items.front();
             }
 
-            inline Instruction& Last()
+            inline Instruction& Last() const
             {
                 auto& items = std::get<TList>(value);
                 return items.back();
@@ -175,10 +108,13 @@ namespace Plang
         class Call : public InstructionFacade
         {
         public:
-            Call(const Instruction& callee, std::initializer_list<Instruction> arguments)
-                : InstructionFacade(InstructionType::Call, TList{ callee, Instruction(InstructionType::Tuple, TList(arguments)) }) { }
-            Call(const Instruction& callee, const Instruction& arguments)
-                : InstructionFacade(InstructionType::Call, TList{ callee, arguments }) { }
+            Call(Arena& arena, const Instruction& callee, std::initializer_list<Instruction> arguments)
+                : Call(arena, callee, Instruction(InstructionType::Tuple, arena.Copy(arguments))) { }
+            Call(Arena& arena, const Instruction& callee, const Instruction& arguments)
+                : InstructionFacade(InstructionType::Call, arena.Copy({ callee, arguments }))
+            {
+                location = callee.location;
+            }
 
             Instruction& Callee()
             {
@@ -196,8 +132,11 @@ namespace Plang
         class Expression : public InstructionFacade
         {
         public:
-            Expression(const Instruction& arguments, const Instruction& body)
-                : InstructionFacade(InstructionType::Expression, TList{ arguments, body }) { }
+            Expression(Arena& arena, const Instruction& arguments, const Instruction& body)
+                : InstructionFacade(InstructionType::Expression, arena.Copy({ arguments, body }))
+            {
+                location = arguments.location;
+            }
 
             Instructions::List& Arguments()
             {
@@ -213,6 +152,8 @@ namespace Plang
         };
     }
 
+    static_assert(std::is_trivially_destructible<Instruction>::value, "Instructions are arena allocated");
+
     std::ostream& operator << (std::ostream& stream, const Plang::Instruction& instruction);
 };
 
@@ -1,5 +1,6 @@
 #include "pch.hpp"
 #include "Lexer.hpp"
+#include "Scanner.hpp"
 
 using namespace Plang;
 
@@ -21,265 +22,417 @@ std::ostream& operator << (std::ostream& Stream, const Plang::LexerToken& Token)
 		"Number",
 		"String",
 	};
-	Stream << std::right << std::setw(13) << types[(size_t)Token.type] << " " << Token.value;
-	//Stream << " @ " << Token.location;
+	Stream << std::right << std::setw(13) << types[(size_t)Token.type] << " " << Token.Text();
+	//Stream << " @ " << Token.Locate();
 	return Stream;
 }
-std::ostream& operator << (std::ostream& Stream, const Plang::Lexer& Lexer)
+
+Lexer::Lexer(const std::string& ModuleName, std::string_view Source)
+	: module(Modules::Register(ModuleName, Source)), source(Source), next(Source.data()), limit(Source.data() + Source.length())
 {
-	for (auto& i : Lexer.tokens)
-		Stream << i << "\n";
-	return Stream;
 }
 
-bool Lexer::CharIsWhitespace(codepoint Char)
+Lexer::Lexer(ModuleId Module, std::string_view Source, const char* Start, LexerTokenType LastType)
+	: module(Module), source(Source), next(Start), limit(Source.data() + Source.length()), lastType(LastType)
 {
-	if (Char <= ' ')
-		return true;
-	switch (Char)
-	{
-	case 160:
-		return true;
+}
+
+Lexer::Lexer(ModuleId Module, uint32_t Offset, uint32_t Length, LexerTokenType LastType)
+	: Lexer(Module, Modules::Source(Module).substr(0, (size_t)Offset + Length), Modules::Source(Module).data() + Offset, LastType)
+{
+}
+
+Lexer::Lexer(const std::string& ModuleName, std::istream& Stream, size_t ChunkSize)
+	: module(Modules::Register(ModuleName)), stream(&Stream), buffer(new char[std::max<size_t>(ChunkSize, 1)]), bufferSize(std::max<size_t>(ChunkSize, 1)), lineStarts(&Modules::StreamedLineStarts(module))
+{
+	next = limit = buffer.get();
+	source = std::string_view(next, 0);
+}
 
-	default:
+bool Lexer::Refill(const char* KeepFrom)
+{
+	if (stream == nullptr || !stream->good())
 		return false;
+
+	//move the kept portion to the front of the window, growing the window if it is already full
+	auto kept = (size_t)(limit - KeepFrom);
+	if (kept == bufferSize)
+	{
+		std::unique_ptr<char[]> grown(new char[bufferSize * 2]);
+		std::copy(KeepFrom, limit, grown.get());
+		buffer = std::move(grown);
+		bufferSize *= 2;
 	}
+	else
+		std::copy(KeepFrom, limit, buffer.get());
+
+	windowOffset += (size_t)(KeepFrom - source.data());
+
+	stream->read(buffer.get() + kept, (std::streamsize)(bufferSize - kept));
+	auto read = (size_t)stream->gcount();
+
+	source = std::string_view(buffer.get(), kept + read);
+	next = buffer.get();
+	limit = next + source.length();
+	return read > 0;
 }
-bool Lexer::CharIsSpecial(codepoint Char)
+
+bool Lexer::NextToken(LexerToken& Token)
 {
-	switch (Char)
+	while (true)
 	{
-	case '+':
-	case '-':
-	case '*':
-	case '/':
-	case '%':
-	case '!':
-	case '^':
-	case '&':
-	case '|':
-	case '~':
-	case '=':
-	case ':':
-	case '?':
-	case '<':
-	case '>':
-		return true;
-	default:
-		return false;
+		auto start = next;
+		auto lines = (lineStarts != nullptr ? lineStarts->size() : 0);
+		auto type = lastType;
+
+		auto read = ReadToken(Token);
+
+		//a token that runs into the end of the window may continue in the next chunk, so read it again once more input is available
+		if (stream == nullptr || (read && next < limit))
+			return read;
+
+		next = start;
+		lineStarts->resize(lines);
+		lastType = type;
+		if (!Refill(start))
+			return ReadToken(Token);
 	}
 }
 
-bool Lexer::CharIsLiteral(codepoint Char)
+std::string_view Lexer::Text(const LexerToken& Token) const
+{
+	if (stream != nullptr)
+		return source.substr(Token.offset - windowOffset, Token.length);
+	return source.substr(Token.offset, Token.length);
+}
+
+Lexer::TokenList Lexer::ReadAll()
 {
-    switch (Char)
-    {
-    case '(':
-    case ')':
-    case '[':
-    case ']':
-    case '{':
-    case '}':
-    case ';':
-    case ',':
-    case '.':
-        return false;
-    default:
-        return !CharIsWhitespace(Char) &&
-               !CharIsSpecial(Char);
-    }
+	TokenList tokens;
+	LexerToken token;
+	while (NextToken(token))
+		tokens.push_back(token);
+	return tokens;
 }
 
-Lexer::Lexer(const std::string& ModuleName, std::istream& Stream)
-	: tokens(), lastLine(0), lineNum(1)
+Lexer::TokenList Lexer::ReadAllParallel(size_t Threads, size_t MinChunkSize)
 {
-	if (!Stream.good())
-		return;
+	if (Threads == 0)
+		Threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+	Threads = std::min(Threads, (size_t)(limit - next) / std::max<size_t>(MinChunkSize, 1));
+	if (stream != nullptr || Threads < 2)
+		return ReadAll();
 
-	while (true)
+	//lex each chunk speculatively. Chunks after the first do not know the previous token and may start inside a string or comment
+	auto starts = FindChunkStarts(Threads);
+	std::vector<TokenList> chunks(starts.size());
+	auto lexChunk = [&](size_t Index)
 	{
-		SkipWhitespace(Stream, CharIsWhitespace);
+		auto chunkEnd = (Index + 1 < starts.size() ? (size_t)(starts[Index + 1] - source.data()) : source.length());
+		Lexer lexer (module, source, starts[Index], Index == 0 ? lastType : LexerTokenType::Invalid);
+		LexerToken token;
+		while (lexer.NextToken(token) && token.offset < chunkEnd)
+			chunks[Index].push_back(token);
+	};
 
-		codepoint ch = 0, nc = 0;
+	std::vector<std::thread> workers;
+	for (size_t i = 1; i < starts.size(); ++i)
+		workers.emplace_back(lexChunk, i);
+	lexChunk(0);
+	for (auto& worker : workers)
+		worker.join();
 
-		LexerToken token;
-		token.value = ch = Stream.get();
-		token.location = { ModuleName, lineNum, (size_t)Stream.tellg() - lastLine };
-
-		if (ch < 0)
-			return;
-		else if (ch == ';')
-			token.type = LexerTokenType::Terminator;
-		else if (ch == ',')
-			token.type = LexerTokenType::Separator;
-		else if (ch == '.')
-		{
-			LexerTokenType type;
-			if (tokens.size() > 0 && (type = tokens.back().type) != LexerTokenType::Identifier && type != LexerTokenType::Accessor && CharIsNumber(Stream.peek()))
-			{
-				token.type = LexerTokenType::Number;
-				token.value += ReadWhile(Stream, CharIsLiteral);
-			}
-			else
-				token.type = LexerTokenType::Accessor;
-		}
-        else if (ch == '(')
-            token.type = LexerTokenType::TupleOpen;
-        else if (ch == ')')
-            token.type = LexerTokenType::TupleClose;
-		else if (ch == '[')
-			token.type = LexerTokenType::ListOpen;
-		else if (ch == ']')
-			token.type = LexerTokenType::ListClose;
-        else if (ch == '{')
-            token.type = LexerTokenType::BlockOpen;
-        else if (ch == '}')
-            token.type = LexerTokenType::BlockClose;
-		else if (CharIsSpecial(ch))
-		{
-			nc = Stream.peek();
-			if (ch == '/' && nc == '/')
-			{
-				token.type = LexerTokenType::Comment;
-				token.value += ReadUntilNewline(Stream);
-			}
-			else if (ch == '/' && nc == '*')
-			{
-				token.type = LexerTokenType::Comment;
-				token.value += ReadUntil(Stream, "*/");
-				token.value += "*/";
-				Stream.seekg(2, std::ios::cur);
-			}
-			else
-			{
-				token.type = LexerTokenType::Identifier;
-				token.value += ReadWhile(Stream, CharIsSpecial);
-			}
-		}
-		else if (ch == '\'' || ch == '"')
-		{
-			token.type = LexerTokenType::String;
-			codepoint prev = 0;
-			token.value += ReadWhile(Stream, [&](codepoint Char)
-			{
-				bool cont = (Char != ch || prev == '\\');
-				prev = Char;
-				return cont;
-			});
-			token.value += Stream.get();
-		}
-		else if (CharIsNumber(ch) || ch == '.')
-		{
-			token.type = LexerTokenType::Number;
-			bool dotted = false;
-			token.value += ReadWhile(Stream, [&](codepoint Char)
-			{
-				bool cont = CharIsLiteral(Char);
-				if (Char == '.')
-				{
-					cont = !dotted;
-					dotted = true;
-				}
-				return cont;
-			});
-		}
-		else
+	//stitch the chunks together, lexing from the end of the previous chunk until a token matches one in the next
+	//The lexer's state after a token depends only on that token, so the rest of the chunk is correct from there
+	TokenList tokens;
+	size_t count = 0;
+	for (auto& chunk : chunks)
+		count += chunk.size();
+	tokens.reserve(count);
+
+	for (auto& chunk : chunks)
+	{
+		auto match = LexUntilMatch(tokens, chunk.cbegin(), chunk.cend());
+		if (match != chunk.cend())
 		{
-			token.type = LexerTokenType::Identifier;
-			token.value += ReadWhile(Stream, CharIsLiteral);
+			tokens.insert(tokens.end(), match, chunk.cend());
+			next = source.data() + chunk.back().offset + chunk.back().length;
+			lastType = chunk.back().type;
 		}
+	}
 
+	//the last chunk may not have matched
+	LexerToken token;
+	while (NextToken(token))
 		tokens.push_back(token);
+	return tokens;
+}
+
+size_t Lexer::Relex(ModuleId Module, std::string_view Source, const SourceEdit& Edit, TokenList& Tokens)
+{
+	Modules::Edit(Module, Source, Edit);
+
+	//tokens that end before the edit are unchanged (the lexer looks at most one UTF-8 sequence past the end of a token)
+	auto first = std::partition_point(Tokens.begin(), Tokens.end(), [&](const LexerToken& Token) { return Token.offset + Token.length + RelexLookahead < Edit.offset; });
+	//tokens that start after the edit may be unchanged, once the lexer is back in step with them
+	auto tail = std::partition_point(first, Tokens.end(), [&](const LexerToken& Token) { return Token.offset < Edit.offset + Edit.removed; });
+
+	auto start = (first == Tokens.begin() ? 0 : first[-1].offset + first[-1].length);
+	Lexer lexer (Module, Source, Source.data() + start, first == Tokens.begin() ? LexerTokenType::Invalid : first[-1].type);
+
+	TokenList relexed;
+	auto shift = (int64_t)Edit.inserted - (int64_t)Edit.removed;
+	auto match = lexer.LexUntilMatch(relexed, tail, Tokens.end(), shift);
+	if (match == Tokens.end())
+	{
+		LexerToken token;
+		while (lexer.NextToken(token))
+			relexed.push_back(token);
 	}
+
+	auto unchanged = Tokens.begin() + (match - Tokens.cbegin());
+	for (auto token = unchanged; token != Tokens.end(); ++token)
+		token->offset = (uint32_t)(token->offset + shift);
+
+	//replace the tokens in [first, unchanged), moving the tail only once
+	auto index = (size_t)(first - Tokens.begin());
+	auto replaced = (size_t)(unchanged - first);
+	if (relexed.size() < replaced)
+		Tokens.erase(first + relexed.size(), unchanged);
+	else
+		Tokens.insert(unchanged, relexed.begin() + replaced, relexed.end());
+	std::copy(relexed.begin(), relexed.begin() + std::min(replaced, relexed.size()), Tokens.begin() + index);
+	return relexed.size();
 }
 
-size_t Lexer::SkipWhitespace(std::istream& Stream, const std::function<bool(codepoint Char)>& WhitespaceCmpFn)
+Lexer::TokenList::const_iterator Lexer::LexUntilMatch(TokenList& Output, TokenList::const_iterator Expected, TokenList::const_iterator End, int64_t Shift)
 {
-	size_t sz = 0;
-	codepoint ch = 0;
-	while ((ch = Stream.peek()) >= 0 && WhitespaceCmpFn(ch))
+	LexerToken token;
+	while (Expected != End && NextToken(token))
 	{
-		sz++;
-		if (Stream.get() == '\n')
-		{
-			lineNum++;
-			lastLine = (size_t)Stream.tellg();
-		}
+		while (Expected != End && Expected->offset + Shift < token.offset)
+			++Expected;
+
+		if (Expected != End &&
+			Expected->offset + Shift == token.offset &&
+			Expected->length == token.length &&
+			Expected->type == token.type)
+			return Expected;
+
+		Output.push_back(token);
 	}
-	return sz;
+	return End;
 }
 
-std::string Lexer::ReadUntil(std::istream& Stream, const std::string& Sequence)
+std::vector<const char*> Lexer::FindChunkStarts(size_t Count) const
 {
-	std::string s;
-	while (true)
+	std::vector<const char*> starts { next };
+	auto chunkSize = (size_t)(limit - next) / Count;
+	auto target = next + chunkSize;
+
+	//strings and comments are followed without lexing, so this can be fooled (e.g. by a quote inside an identifier). ReadAllParallel corrects for that
+	auto position = next;
+	while (starts.size() < Count && target < limit)
 	{
-		size_t i;
-		for (i = 0; i < Sequence.length(); i++)
-		{
-			codepoint ch = Stream.get();
-			if (ch < 0)
-				return s;
+		auto stop = Scanner::FindQuoteOrSlash(position, limit);
+		auto previous = (stop > source.data() ? CharClass::Of(stop[-1]) : (uint8_t)CharClass::Whitespace);
 
-			if (ch == '\n')
+		const char* skipTo = nullptr; //the end of the string or comment starting at stop
+		if (stop + 1 < limit && *stop == '/' && (previous & CharClass::Special) == 0) //specials are read together (e.g. +//)
+		{
+			if (stop[1] == '/')
 			{
-				lineNum++;
-				lastLine = (size_t)Stream.tellg();
+				skipTo = static_cast<const char*>(memchr(stop, '\n', (size_t)(limit - stop)));
+				if (skipTo == nullptr)
+					skipTo = limit;
 			}
-			s += ch;
-			if (s.back() != Sequence[i])
+			else if (stop[1] == '*')
+				skipTo = std::min(Scanner::FindBlockCommentEnd(stop + 2, limit) + 2, limit);
+		}
+		else if (stop < limit && *stop != '/' && (previous & CharClass::LiteralEnd) != 0) //quotes inside literals are part of the literal
+			skipTo = std::min(Scanner::FindStringEnd(stop + 1, limit, *stop) + 1, limit);
+
+		//split points before the stop start at the next whitespace
+		while (target < stop && starts.size() < Count)
+		{
+			auto space = std::find_if(target, stop, [](char Char) { return CharClass::Is(Char, CharClass::Whitespace); });
+			if (space == stop)
 				break;
+			starts.push_back(space);
+			target = space + chunkSize;
+		}
+
+		if (stop >= limit)
+			break;
+		if (skipTo == nullptr)
+		{
+			position = stop + 1;
+			continue;
 		}
-		if (i == Sequence.length())
+
+		//split points inside the string or comment start after it
+		if (target < skipTo && skipTo < limit && starts.size() < Count)
 		{
-			s.resize(s.length() - i);
-			Stream.seekg(-(ptrdiff_t)i, std::ios::cur);
-			return s;
+			starts.push_back(skipTo);
+			target = skipTo + chunkSize;
 		}
+		position = skipTo;
 	}
-	return s;
+	return starts;
 }
 
-std::string Lexer::ReadUntilNewline(std::istream& Stream)
+bool Lexer::ReadToken(LexerToken& token)
 {
-	std::string s;
-	codepoint ch = 0;
-	while ((ch = Stream.peek()) >= 0 && ch != '\n')
+	SkipWhitespace();
+
+	if (next >= limit)
+		return false;
+
+	auto start = next;
+	token.offset = (uint32_t)Offset();
+	token.module = module;
+
+	codepoint ch = (unsigned char)*next++, nc = 0;
+
+	if (ch == ';')
+		token.type = LexerTokenType::Terminator;
+	else if (ch == ',')
+		token.type = LexerTokenType::Separator;
+	else if (ch == '.')
 	{
-		if (ch == '\r')
+		if (lastType != LexerTokenType::Invalid && lastType != LexerTokenType::Identifier && lastType != LexerTokenType::Accessor && CharIsNumber(Peek()))
 		{
-			ch = Stream.get();
-			if (ch < 0)
-				return s;
-
-			if (Stream.good() && Stream.peek() == '\n')
-			{
-				lineNum++;
-				lastLine = (size_t)Stream.tellg();
-				return s;
-			}
-			s += ch;
+			token.type = LexerTokenType::Number;
+			ReadLiteral();
 		}
 		else
-			s += Stream.get();
+			token.type = LexerTokenType::Accessor;
 	}
+    else if (ch == '(')
+        token.type = LexerTokenType::TupleOpen;
+    else if (ch == ')')
+        token.type = LexerTokenType::TupleClose;
+	else if (ch == '[')
+		token.type = LexerTokenType::ListOpen;
+	else if (ch == ']')
+		token.type = LexerTokenType::ListClose;
+    else if (ch == '{')
+        token.type = LexerTokenType::BlockOpen;
+    else if (ch == '}')
+        token.type = LexerTokenType::BlockClose;
+	else if (CharIsSpecial(ch))
+	{
+		nc = Peek();
+		if (ch == '/' && nc == '/')
+		{
+			token.type = LexerTokenType::Comment;
+			ReadUntilNewline();
+		}
+		else if (ch == '/' && nc == '*')
+		{
+			token.type = LexerTokenType::Comment;
+			ReadBlockComment();
+		}
+		else
+		{
+			token.type = LexerTokenType::Identifier;
+			ReadWhile([](unsigned char Char) { return CharClass::Is(Char, CharClass::Special); });
+		}
+	}
+	else if (ch == '\'' || ch == '"')
+	{
+		token.type = LexerTokenType::String;
+		ReadString((char)ch);
+	}
+	else if (CharIsNumber(ch) || ch == '.')
+	{
+		token.type = LexerTokenType::Number;
+		ReadLiteral();
+		if (Peek() == '.') //numbers may contain one decimal point
+		{
+			++next;
+			ReadLiteral();
+		}
+	}
+	else
+	{
+		token.type = LexerTokenType::Identifier;
+		next = start; //the first character may begin a UTF-8 sequence
+		ReadLiteral();
+	}
+
+	token.length = (uint32_t)(next - start);
+	lastType = token.type;
+	return true;
+}
 
-	return s;
+void Lexer::IndexLines(const char* Begin, const char* End)
+{
+	if (lineStarts != nullptr)
+		Scanner::IndexLines(Begin, End, (uint32_t)(windowOffset + (size_t)(Begin - source.data())), *lineStarts);
 }
 
-std::string Lexer::ReadWhile(std::istream& Stream, std::function<bool(codepoint Char)> ConditionFn)
+size_t Lexer::SkipWhitespace()
 {
-	std::string s;
-	codepoint ch = 0;
-	while ((ch = Stream.peek()) >= 0 && ConditionFn(ch))
+	auto start = next;
+	if (next < limit && CharClass::Is(*next, CharClass::Whitespace)) //most runs are a single space
+		next = Scanner::SkipWhitespace(next + 1, limit);
+
+	codepoint ch;
+	size_t length;
+	while (next < limit && CharClass::Is(*next, CharClass::NonAscii) &&
+		   (length = CharClass::DecodeUtf8(next, limit, ch)) > 0 && CharClass::IsUnicodeWhitespace(ch))
+		next = Scanner::SkipWhitespace(next + length, limit);
+
+	IndexLines(start, next);
+	return (size_t)(next - start);
+}
+
+std::string_view Lexer::ReadLiteral()
+{
+	auto start = next;
+	next = Scanner::SkipLiteral(next, limit);
+	while (next < limit && CharClass::Is(*next, CharClass::NonAscii)) //the scanner stops at UTF-8 sequences
 	{
-		ch = Stream.get();
-		if (ch == '\n')
-		{
-			lineNum++;
-			lastLine = (size_t)Stream.tellg();
-		}
-		s += ch;
+		codepoint ch;
+		auto length = CharClass::DecodeUtf8(next, limit, ch);
+		if (length == 0) //cut off by the end of the window
+			next = limit;
+		else if (CharClass::IsUnicodeWhitespace(ch))
+			break;
+		else
+			next = Scanner::SkipLiteral(next + length, limit);
 	}
-	return s;
+	return std::string_view(start, (size_t)(next - start));
+}
+
+std::string_view Lexer::ReadBlockComment()
+{
+	auto start = next;
+	auto stop = Scanner::FindBlockCommentEnd(std::min(next + 1, limit), limit); //skip the opening * so that /*/ is not closed
+	IndexLines(next, stop);
+	next = std::min(stop + 2, limit);
+	return std::string_view(start, (size_t)(next - start));
+}
+
+std::string_view Lexer::ReadString(char Quote)
+{
+	auto start = next;
+	auto stop = Scanner::FindStringEnd(next, limit, Quote);
+	IndexLines(next, stop);
+	next = std::min(stop + 1, limit);
+	return std::string_view(start, (size_t)(next - start));
+}
+
+std::string_view Lexer::ReadUntilNewline()
+{
+	auto start = next;
+	auto stop = static_cast<const char*>(memchr(next, '\n', (size_t)(limit - next)));
+	if (stop == nullptr)
+		stop = limit;
+	else if (stop > next && stop[-1] == '\r') //the newline is consumed as whitespace
+		--stop;
+
+	next = stop;
+	return std::string_view(start, (size_t)(next - start));
 }
@@ -1,10 +1,12 @@
 #pragma once
 #include "pch.hpp"
 #include "Location.hpp"
+#include "Module.hpp"
+#include "CharClass.hpp"
 
 namespace Plang
 {
-	enum class LexerTokenType
+	enum class LexerTokenType : uint8_t
 	{
 		Invalid,
 		Comment,
@@ -22,45 +24,151 @@ namespace Plang
 		String
 	};
 
+	//Tokens only store their position. Their text and location are recovered from the module's source when needed
 	struct LexerToken
 	{
+		uint32_t offset; //byte offset of the token in its module
+		uint32_t length;
+		ModuleId module;
 		LexerTokenType type;
-		std::string value;
-		Location location;
 
 		LexerToken() = default;
-        LexerToken(LexerTokenType type, const std::string& value, Location location)
-            : type(type), value(value), location(location) { }
-	};
+		LexerToken(LexerTokenType type, uint32_t offset, uint32_t length, ModuleId module)
+			: offset(offset), length(length), module(module), type(type) { }
 
-	//todo: change to work like stringstream
+		inline std::string_view Text() const { return Modules::Source(module).substr(offset, length); } //empty if the module's source is not kept (use Lexer::Text)
+		inline Location Locate() const { return { module, offset }; }
+	};
+	static_assert(sizeof(LexerToken) == 16, "LexerToken should stay compact");
 
+	//A pull based token source. Tokens are read one at a time with NextToken() (or by iterating the lexer)
 	class Lexer
 	{
 	public:
 		using TokenList = std::vector<LexerToken>;
 
+		static constexpr size_t DefaultChunkSize = 64 * 1024;
+		static constexpr size_t DefaultParallelChunkSize = 1024 * 1024;
+
 		Lexer() = default;
-		Lexer(const std::string& ModuleName, std::istream& Input);
+		Lexer(const std::string& ModuleName, std::string_view Source); //Source must outlive the read tokens
+		Lexer(const std::string& ModuleName, std::istream& Input, size_t ChunkSize = DefaultChunkSize); //reads the input in chunks. The source is not kept, so Text() only works for the last read token
+		Lexer(ModuleId Module, uint32_t Offset, uint32_t Length, LexerTokenType LastType = LexerTokenType::Invalid); //lex part of a registered module whose source is kept. LastType is the type of the token before it
+
+		Lexer(Lexer&&) = default;
+		Lexer& operator = (Lexer&&) = default;
+
+		static constexpr inline bool CharIsWhitespace(codepoint Char)
+		{
+			return (Char >= 0 && Char < 0x80) ? CharClass::Is((unsigned char)Char, CharClass::Whitespace) : CharClass::IsUnicodeWhitespace(Char);
+		}
+		static constexpr inline bool CharIsNumber(codepoint Char) { return (Char >= '0' && Char <= '9'); }
+		static constexpr inline bool CharIsSpecial(codepoint Char) //characters that are valid sub-symbol characters (can only be by themselves, e.g: + - * %)
+		{
+			return (Char >= 0 && Char < 0x80) && CharClass::Is((unsigned char)Char, CharClass::Special);
+		}
+		static constexpr inline bool CharIsLiteral(codepoint Char) //char is not a splitter, encloser, or whitespace
+		{
+			return (Char >= 0 && Char < 0x80) ? !CharClass::Is((unsigned char)Char, CharClass::LiteralEnd) : (Char > 0 && !CharClass::IsUnicodeWhitespace(Char));
+		}
+
+		bool NextToken(LexerToken& Token); //Read the next token. Returns false at the end of the input
+		TokenList ReadAll(); //Read all of the remaining tokens
+
+		//Read all of the remaining tokens, lexing chunks of at least MinChunkSize bytes on separate threads (Threads = 0 uses one per core)
+		//Streams are read sequentially. The chunks only read the module's source. Creating lexers, parsing and registering modules are not locked
+		//(see Modules::Register and Symbols::Intern), so those must not run on other threads at the same time
+		TokenList ReadAllParallel(size_t Threads = 0, size_t MinChunkSize = DefaultParallelChunkSize);
+
+		//Update the tokens of a buffered module after its source was edited. Source is the edited source (and replaces the module's source)
+		//Only the tokens around the edit are lexed again. Returns the number of tokens that were lexed
+		static size_t Relex(ModuleId Module, std::string_view Source, const SourceEdit& Edit, TokenList& Tokens);
+
+		inline ModuleId Module() const { return module; }
+		std::string_view Text(const LexerToken& Token) const;
+
+		class Iterator
+		{
+		public:
+			using iterator_category = std::input_iterator_tag;
+			using value_type = LexerToken;
+			using difference_type = ptrdiff_t;
+			using pointer = const LexerToken*;
+			using reference = const LexerToken&;
+
+			Iterator() = default;
+			Iterator(Lexer* lexer) : lexer(lexer) { ++*this; }
+
+			inline reference operator *() const { return token; }
+			inline pointer operator ->() const { return &token; }
+			inline Iterator& operator ++()
+			{
+				if (!lexer->NextToken(token))
+					lexer = nullptr;
+				return *this;
+			}
+
+			inline bool operator ==(const Iterator& other) const { return lexer == other.lexer; }
+			inline bool operator !=(const Iterator& other) const { return lexer != other.lexer; }
 
-		static bool CharIsWhitespace(codepoint Char);
-		static inline bool CharIsNumber(codepoint Char) { return (Char >= '0' && Char <= '9'); }
-		static bool CharIsSpecial(codepoint Char); //characters that are valid sub-symbol characters (can only be by themselves, e.g: + - * %)
-		static bool CharIsLiteral(codepoint Char); //char is not a splitter, encloser, or whitespace
+		protected:
+			Lexer* lexer = nullptr;
+			LexerToken token;
+		};
 
-		TokenList tokens;
+		inline Iterator begin() { return Iterator(this); }
+		inline Iterator end() { return Iterator(); }
 
 	protected:
-		size_t lastLine; //last lineNum
-		size_t lineNum;
+		Lexer(ModuleId Module, std::string_view Source, const char* Start, LexerTokenType LastType); //lex part of an already registered source
+
+		static constexpr uint32_t RelexLookahead = 4; //how far past the end of a token the lexer may look
+
+		ModuleId module = 0;
+		std::string_view source; //the current window of the input
+
+		std::istream* stream = nullptr; //null if lexing a complete buffer
+		std::unique_ptr<char[]> buffer; //window storage for stream input
+		size_t bufferSize = 0;
+		size_t windowOffset = 0; //offset of the window in the input
+
+		const char* next = nullptr; //the next character to read
+		const char* limit = nullptr; //the end of the window
+
+		std::vector<uint32_t>* lineStarts = nullptr; //the module's line index, built while reading streams (buffered sources are indexed on demand)
+
+		LexerTokenType lastType = LexerTokenType::Invalid; //type of the previously read token, or Invalid if none
+
+		bool ReadToken(LexerToken& Token);
+		bool Refill(const char* KeepFrom); //read more of the stream, keeping everything after KeepFrom. Returns false if the stream is exhausted
+
+		inline size_t Offset() const { return windowOffset + (size_t)(next - source.data()); }
+		inline codepoint Peek() const { return next < limit ? (unsigned char)*next : -1; }
+
+		void IndexLines(const char* Begin, const char* End); //record the lines starting in a range that was skipped over
+
+		//Lex tokens into Output until one is the same as a token in [Expected, End) (whose offsets are moved by Shift). Returns the matching token or End
+		TokenList::const_iterator LexUntilMatch(TokenList& Output, TokenList::const_iterator Expected, TokenList::const_iterator End, int64_t Shift = 0);
+
+		//Pick where to start lexing each chunk of the remaining source: the first whitespace after each split point that is (likely) not in a string or comment
+		std::vector<const char*> FindChunkStarts(size_t Count) const;
+
+		//Skip whitespace characters. Returns the number of whitespace characters counted
+		size_t SkipWhitespace();
+		std::string_view ReadLiteral();
+		std::string_view ReadBlockComment(); //reads past the closing */
+		std::string_view ReadString(char Quote); //reads past the closing quote. Quotes can be escaped with a backslash
+		std::string_view ReadUntilNewline();
 
-		//Skip whitespace characters (defined by WhitespaceCmp). Returns the number of whitespace characters counted
-		size_t SkipWhitespace(std::istream& Stream, const std::function<bool(codepoint Char)>& WhitespaceCmpFn);
-		std::string ReadUntil(std::istream& Stream, const std::string& Sequence);
-		std::string ReadUntilNewline(std::istream& Stream);
-		std::string ReadWhile(std::istream& Stream, std::function<bool(codepoint Char)> ConditionFn);
+		template <typename TCondition>
+		inline std::string_view ReadWhile(TCondition Condition) //Condition is called with each byte
+		{
+			auto start = next;
+			while (next < limit && Condition((unsigned char)*next))
+				++next;
+			return std::string_view(start, (size_t)(next - start));
+		}
 
 	};
 };
-extern std::ostream& operator << (std::ostream& Stream, const Plang::Lexer& Lexer);
 extern std::ostream& operator << (std::ostream& Stream, const Plang::LexerToken& Token);
@@ -4,38 +4,29 @@
 
 namespace Plang
 {
+    using ModuleId = uint32_t;
+    constexpr ModuleId NoModule = ~(ModuleId)0;
+
+    //A position in a module's source. The line and column are only calculated when needed (see Modules::Resolve)
     struct Location
     {
-        std::string module;
-        size_t line = 0;
-        size_t column = 0;
+        ModuleId module = NoModule;
+        uint32_t offset = 0; //byte offset in the module's source
 
         inline bool operator == (const Location& other) const
         {
             return (module == other.module &&
-                    line   == other.line &&
-                    column == other.column);
+                    offset == other.offset);
         }
 
         inline bool operator != (const Location& other) const
         {
             return (module != other.module ||
-                    line   != other.line ||
-                    column != other.column);
+                    offset != other.offset);
         }
 
-        inline operator std::string() const
-        {
-            return module + ":" + std::to_string(line) + "," + std::to_string(column);
-        }
+        operator std::string() const; //module:line,column
     };
 
-    inline std::ostream& operator << (std::ostream& stream, const Location& location)
-    {
-		stream << (location.module.empty() ? "(#!)" : location.module);
-        stream << std::dec << std::noshowbase << ":";
-        stream << location.line << ",";
-        stream << location.column;
-        return stream;
-    }
+    std::ostream& operator << (std::ostream& stream, const Location& location);
 }
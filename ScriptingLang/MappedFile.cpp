@@ -0,0 +1,117 @@
+#include "pch.hpp"
+#include "MappedFile.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace Plang;
+
+MappedFile& MappedFile::operator = (MappedFile&& other) noexcept
+{
+    if (&other != this)
+    {
+        Close();
+        data = other.data;
+        length = other.length;
+        isOpen = other.isOpen;
+        writable = other.writable;
+
+        other.data = nullptr;
+        other.length = 0;
+        other.isOpen = false;
+        other.writable = false;
+    }
+    return *this;
+}
+
+bool MappedFile::Open(const std::string& path, bool writable)
+{
+    Close();
+
+#ifdef _WIN32
+    auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    //empty files cannot be mapped
+    if (size.QuadPart > 0)
+    {
+        auto mapping = CreateFileMappingA(file, nullptr, writable ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (mapping == nullptr)
+            return false;
+
+        data = static_cast<const char*>(MapViewOfFile(mapping, writable ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0));
+        CloseHandle(mapping); //the view keeps the mapping alive
+        if (data == nullptr)
+            return false;
+    }
+    else
+        CloseHandle(file);
+
+    length = (size_t)size.QuadPart;
+#else
+    auto file = open(path.c_str(), O_RDONLY);
+    if (file < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(file, &info) != 0)
+    {
+        close(file);
+        return false;
+    }
+
+    //empty files cannot be mapped
+    if (info.st_size > 0)
+    {
+        auto view = mmap(nullptr, (size_t)info.st_size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_PRIVATE, file, 0);
+        close(file); //the mapping keeps the file alive
+        if (view == MAP_FAILED)
+            return false;
+
+        madvise(view, (size_t)info.st_size, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(view);
+    }
+    else
+        close(file);
+
+    length = (size_t)info.st_size;
+#endif
+
+    isOpen = true;
+    this->writable = writable;
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (data != nullptr)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap(const_cast<char*>(data), length);
+#endif
+    }
+
+    data = nullptr;
+    length = 0;
+    isOpen = false;
+    writable = false;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "pch.hpp"
+
+namespace Plang
+{
+    //A read-only view of a file mapped into memory. The view remains valid for the lifetime of this object
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        MappedFile(const std::string& path, bool writable = false) { Open(path, writable); }
+        ~MappedFile() { Close(); }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator = (const MappedFile&) = delete;
+
+        MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+        MappedFile& operator = (MappedFile&& other) noexcept;
+
+        //Returns false if the file could not be opened or mapped.
+        //A writable view is private to this process (copy-on-write), changes are never written back to the file
+        bool Open(const std::string& path, bool writable = false);
+        void Close();
+
+        inline bool IsOpen() const { return isOpen; }
+        inline const char* Data() const { return data; }
+        inline size_t Length() const { return length; }
+        inline std::string_view View() const { return { data, length }; }
+        inline char* WritableData() const { return writable ? const_cast<char*>(data) : nullptr; }
+
+    protected:
+        const char* data = nullptr;
+        size_t length = 0;
+        bool isOpen = false;
+        bool writable = false;
+    };
+};
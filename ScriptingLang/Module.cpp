@@ -0,0 +1,99 @@
+#include "pch.hpp"
+#include "Module.hpp"
+#include "Scanner.hpp"
+
+using namespace Plang;
+
+std::deque<ModuleInfo> Modules::modules;
+
+ModuleId Modules::Register(const std::string& Name, std::string_view Source, std::shared_ptr<const void> Owner)
+{
+    modules.push_back({ Name, Source, std::move(Owner), {}, false, 0, nullptr });
+    return (ModuleId)(modules.size() - 1);
+}
+
+void Modules::Edit(ModuleId Id, std::string_view Source, const SourceEdit& Edit, std::shared_ptr<const void> Owner)
+{
+    auto& module = modules[Id];
+    module.source = Source;
+    if (Owner != nullptr)
+        module.owner = std::move(Owner);
+    ++module.revision;
+    module.deferredBodies = nullptr; //the offsets of the old bodies are out of date. Trees parsed from them keep their arena
+
+    if (!module.linesIndexed)
+        return;
+
+    //replace the lines that started in the removed text and shift the rest
+    auto& lines = module.lineStarts;
+    auto first = std::upper_bound(lines.begin(), lines.end(), Edit.offset);
+    auto last = std::upper_bound(first, lines.end(), Edit.offset + Edit.removed);
+    auto shift = (int64_t)Edit.inserted - (int64_t)Edit.removed;
+    for (auto line = last; line != lines.end(); ++line)
+        *line = (uint32_t)(*line + shift);
+
+    std::vector<uint32_t> inserted;
+    Scanner::IndexLines(Source.data() + Edit.offset, Source.data() + Edit.offset + Edit.inserted, Edit.offset, inserted);
+    lines.insert(lines.erase(first, last), inserted.begin(), inserted.end());
+}
+
+std::vector<uint32_t>& Modules::StreamedLineStarts(ModuleId Id)
+{
+    auto& module = modules[Id];
+    if (!module.linesIndexed)
+    {
+        module.lineStarts.assign(1, 0);
+        module.linesIndexed = true;
+    }
+    return module.lineStarts;
+}
+
+const std::vector<uint32_t>& Modules::LineStarts(ModuleId Id)
+{
+    auto& module = modules[Id];
+    if (!module.linesIndexed)
+    {
+        module.lineStarts.assign(1, 0);
+        Scanner::IndexLines(module.source.data(), module.source.data() + module.source.length(), 0, module.lineStarts);
+        module.linesIndexed = true;
+    }
+    return module.lineStarts;
+}
+
+void Modules::SetLineStarts(ModuleId Id, std::vector<uint32_t> LineStarts)
+{
+    auto& module = modules[Id];
+    module.lineStarts = std::move(LineStarts);
+    module.linesIndexed = true;
+}
+
+LineColumn Modules::Resolve(const Location& Location)
+{
+    if (Location.module == NoModule)
+        return { };
+
+    //first line that starts after the offset
+    auto& lineStarts = LineStarts(Location.module);
+    auto next = std::upper_bound(lineStarts.begin(), lineStarts.end(), Location.offset);
+    auto line = (size_t)(next - lineStarts.begin());
+    return { line, Location.offset - *(next - 1) + 1 };
+}
+
+Location::operator std::string() const
+{
+    std::ostringstream s;
+    s << *this;
+    return s.str();
+}
+
+std::ostream& Plang::operator << (std::ostream& stream, const Location& location)
+{
+    if (location.module == NoModule || Modules::Name(location.module).empty())
+        stream << "(#!)";
+    else
+        stream << Modules::Name(location.module);
+
+    auto lc = Modules::Resolve(location);
+    stream << ":" << lc.line << "," << lc.column;
+    return stream;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Location.hpp"
+
+namespace Plang
+{
+    struct DeferredBodies; //see Parser::ParseDeferred
+
+    struct ModuleInfo
+    {
+        std::string name;
+        std::string_view source; //empty if the module's source is not kept in memory (e.g. streamed)
+        std::shared_ptr<const void> owner; //keeps the source alive (optional)
+
+        //offsets of the start of each line. Built from the source on first use, or filled in by the lexer while streaming
+        std::vector<uint32_t> lineStarts;
+        bool linesIndexed = false;
+
+        uint32_t revision = 0; //the number of times the source has been edited
+        std::shared_ptr<DeferredBodies> deferredBodies; //the bodies parsed from the current revision. Dropped when the source is edited
+    };
+
+    //A change to a module's source: Removed bytes at Offset were replaced by Inserted bytes
+    struct SourceEdit
+    {
+        uint32_t offset = 0;
+        uint32_t removed = 0;
+        uint32_t inserted = 0;
+    };
+
+    struct LineColumn
+    {
+        size_t line = 0; //1 based, 0 if unknown
+        size_t column = 0;
+    };
+
+    //Registry of loaded modules. Tokens and locations refer to modules by id.
+    //Modules are never removed, so sources that are replaced often (such as REPL lines) should reuse one module through Edit.
+    //The registry is not locked: modules must not be registered or edited while another thread uses it
+    class Modules
+    {
+    public:
+        static ModuleId Register(const std::string& Name, std::string_view Source = { }, std::shared_ptr<const void> Owner = nullptr);
+
+        static inline size_t Count() { return modules.size(); }
+        static inline const ModuleInfo& Get(ModuleId Id) { return modules[Id]; }
+        static inline const std::string& Name(ModuleId Id) { return modules[Id].name; }
+        static inline std::string_view Source(ModuleId Id) { return modules[Id].source; }
+
+        static inline uint32_t Revision(ModuleId Id) { return modules[Id].revision; }
+        static inline std::shared_ptr<DeferredBodies>& Deferred(ModuleId Id) { return modules[Id].deferredBodies; }
+
+        //Replace the source of a module after an edit, updating its line index if it has one. Bodies deferred before the edit can no longer be parsed
+        static void Edit(ModuleId Id, std::string_view Source, const SourceEdit& Edit, std::shared_ptr<const void> Owner = nullptr);
+
+        //The line start table of a module that is being streamed (and whose source will not be available to index later)
+        static std::vector<uint32_t>& StreamedLineStarts(ModuleId Id);
+
+        //The offsets of the start of each line in a module, indexing the module's source if necessary
+        static const std::vector<uint32_t>& LineStarts(ModuleId Id);
+        static void SetLineStarts(ModuleId Id, std::vector<uint32_t> LineStarts); //use a precomputed line index (e.g. from a cache)
+
+        //Calculate the line and column of a location (indexing the module's lines if necessary)
+        static LineColumn Resolve(const Location& Location);
+
+    protected:
+        static std::deque<ModuleInfo> modules;
+    };
+};
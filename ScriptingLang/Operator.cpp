@@ -0,0 +1,67 @@
+#include "pch.hpp"
+#include "Operator.hpp"
+
+using namespace Plang;
+
+const OperatorTable& OperatorTable::Default()
+{
+    static const OperatorTable table = []()
+    {
+        OperatorTable t;
+        auto define = [&](std::string_view name, Notation notation, Association association, unsigned precedence)
+        {
+            t.Define(Symbols::Intern(name), notation, association, precedence);
+        };
+
+        for (auto name : { "++", "--" })
+            define(name, Notation::Postfix, Association::LeftToRight, 1);
+        for (auto name : { "++", "--", "!", "+", "-", "~", "=" })
+            define(name, Notation::Prefix, Association::RightToLeft, 2);
+
+        define("*", Notation::Infix, Association::LeftToRight, 3);
+        define("/", Notation::Infix, Association::LeftToRight, 3);
+        define("%", Notation::Infix, Association::LeftToRight, 3);
+
+        define("+", Notation::Infix, Association::LeftToRight, 4);
+        define("-", Notation::Infix, Association::LeftToRight, 4);
+
+        define("<<", Notation::Infix, Association::LeftToRight, 5);
+        define(">>", Notation::Infix, Association::LeftToRight, 5);
+
+        define("<", Notation::Infix, Association::LeftToRight, 6);
+        define("<=", Notation::Infix, Association::LeftToRight, 6);
+        define(">=", Notation::Infix, Association::LeftToRight, 6);
+        define(">", Notation::Infix, Association::LeftToRight, 6);
+
+        define("==", Notation::Infix, Association::LeftToRight, 7);
+        define("!=", Notation::Infix, Association::LeftToRight, 7);
+
+        define("&", Notation::Infix, Association::LeftToRight, 8);
+
+        define("^", Notation::Infix, Association::LeftToRight, 9);
+
+        define("|", Notation::Infix, Association::LeftToRight, 10);
+
+        define("&&", Notation::Infix, Association::LeftToRight, 11);
+
+        define("||", Notation::Infix, Association::LeftToRight, 12);
+
+        define(":", Notation::Infix, Association::RightToLeft, 14);
+        define("=", Notation::Infix, Association::RightToLeft, 14);
+        //todo: other assignments
+
+        return t;
+    }();
+    return table;
+}
+
+void OperatorTable::Define(SymbolId Symbol, Notation Notation, Association Association, unsigned Precedence)
+{
+    if (Symbol >= operators.size())
+        operators.resize(Symbol + 1);
+
+    auto& op = operators[Symbol][(size_t)Notation];
+    op.defined = true;
+    op.association = Association;
+    op.precedence = Precedence;
+}
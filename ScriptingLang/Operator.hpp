@@ -0,0 +1,50 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Symbol.hpp"
+
+namespace Plang
+{
+    enum class Association
+    {
+        None,
+        LeftToRight,
+        RightToLeft
+    };
+
+    enum class Notation
+    {
+        Prefix,
+        Infix,
+        Postfix
+    };
+
+    struct Operator
+    {
+        bool defined = false;
+        Association association = Association::None;
+        unsigned precedence = 0; //lower numbers = higher precedence
+    };
+
+    //The operators available to a module, indexed by symbol id.
+    //An operator can be defined once for each notation (e.g. - is both prefix and infix)
+    class OperatorTable
+    {
+    public:
+        static const OperatorTable& Default(); //the built in operators
+
+        void Define(SymbolId Symbol, Notation Notation, Association Association, unsigned Precedence);
+
+        //returns null if the symbol is not an operator with this notation
+        inline const Operator* Find(SymbolId Symbol, Notation Notation) const
+        {
+            if (Symbol >= operators.size())
+                return nullptr;
+            auto& op = operators[Symbol][(size_t)Notation];
+            return op.defined ? &op : nullptr;
+        }
+
+    protected:
+        std::vector<std::array<Operator, 3>> operators;
+    };
+};
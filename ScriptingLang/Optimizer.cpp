@@ -0,0 +1,172 @@
+#include "pch.hpp"
+#include "Optimizer.hpp"
+#include "Builtins.hpp"
+
+using namespace Plang;
+
+void Optimizer::Optimize(Instruction& Root)
+{
+    if (foldConstants)
+        FindValueUses(Root);
+
+    //children are optimized before their parents so that nested constants fold ( 1 + 2 * 3 )
+    struct Visit
+    {
+        Instruction* instruction;
+        bool visited;
+    };
+    std::vector<Visit> stack { { &Root, false } };
+    while (!stack.empty())
+    {
+        auto visit = stack.back();
+        auto list = std::get_if<TList>(&visit.instruction->value);
+        if (list != nullptr && !visit.visited)
+        {
+            stack.back().visited = true;
+            for (auto& item : *list)
+                stack.push_back({ &item, false });
+            continue;
+        }
+
+        stack.pop_back();
+        if (list == nullptr)
+            continue;
+
+        Simplify(*visit.instruction);
+        if (foldConstants && visit.instruction->type == InstructionType::Call)
+            TryFold(*visit.instruction);
+    }
+}
+
+void Optimizer::FindValueUses(const Instruction& Root)
+{
+    std::vector<const Instruction*> stack { &Root };
+    while (!stack.empty())
+    {
+        auto& instruction = *stack.back();
+        stack.pop_back();
+
+        auto list = std::get_if<TList>(&instruction.value);
+        if (list == nullptr)
+            continue;
+
+        for (size_t i = 0; i < list->size(); ++i)
+        {
+            auto& item = (*list)[i];
+            stack.push_back(&item);
+
+            //callees and property names do not use the scope's value of a name
+            if (item.type != InstructionType::Identifier || item.symbol == NoSymbol ||
+                (instruction.type == InstructionType::Call && i == 0) ||
+                (instruction.type == InstructionType::Accessor && i > 0))
+                continue;
+            foldable[item.symbol] = false;
+        }
+    }
+}
+
+//the value of a literal operand, or null for a missing operand (of a prefix operator)
+static bool ToOperand(const Instruction& Instruction, Builtins::Operand& Operand)
+{
+    switch (Instruction.type)
+    {
+    case InstructionType::Int:
+        Operand = std::get<TInt>(Instruction.value);
+        return true;
+    case InstructionType::Float:
+        Operand = std::get<TFloat>(Instruction.value);
+        return true;
+    case InstructionType::String:
+        Operand = std::string(std::get<TString>(Instruction.value));
+        return true;
+    case InstructionType::Unknown:
+        Operand = nullptr;
+        return std::holds_alternative<std::nullptr_t>(Instruction.value);
+    default:
+        return false;
+    }
+}
+
+bool Optimizer::TryFold(Instruction& Call)
+{
+    auto& call = Call.As<Instructions::Call>();
+    auto& callee = call.Callee();
+    auto& arguments = call.Arguments();
+    if (callee.type != InstructionType::Identifier || callee.symbol == NoSymbol || arguments.Count() != 2)
+        return false;
+
+    auto found = foldable.find(callee.symbol);
+    if (found == foldable.end())
+        found = foldable.emplace(callee.symbol, !scope.Has(std::string(Symbols::Name(callee.symbol)))).first;
+    if (!found->second)
+        return false;
+
+    Builtins::Operand left, right;
+    if (!ToOperand(arguments[0], left) || !ToOperand(arguments[1], right))
+        return false;
+
+    auto op = Symbols::Name(callee.symbol);
+    auto result = Builtins::Apply(op, left, right);
+
+    Instruction literal;
+    if (auto i = std::get_if<TInt>(&result))
+        literal = Instruction(InstructionType::Int, *i);
+    else if (auto f = std::get_if<TFloat>(&result))
+        literal = Instruction(InstructionType::Float, *f);
+    else if (auto s = std::get_if<std::string>(&result))
+        literal = Instruction(InstructionType::String, arena->Copy(*s));
+    else
+        return false;
+    literal.location = Call.location;
+
+    if (dump != nullptr)
+    {
+        *dump << "fold ";
+        if (std::holds_alternative<std::nullptr_t>(right))
+            *dump << op << (std::string)arguments[0];
+        else
+            *dump << (std::string)arguments[0] << " " << op << " " << (std::string)arguments[1];
+        *dump << " -> " << (std::string)literal << " @ " << (std::string)literal.location << "\n";
+    }
+
+    Call = literal;
+    ++folded;
+    return true;
+}
+
+void Optimizer::Simplify(Instruction& List)
+{
+    auto items = std::get<TList>(List.value);
+    auto isStatements = (List.type == InstructionType::Program || List.type == InstructionType::Block);
+
+    size_t count = 0;
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        auto item = items[i];
+        auto tuple = (item.type == InstructionType::Tuple ? std::get_if<TList>(&item.value) : nullptr);
+
+        if (stripEmptyStatements && isStatements &&
+            (item.type == InstructionType::Statement || (tuple != nullptr && tuple->empty())))
+        {
+            if (dump != nullptr)
+                *dump << "strip empty statement @ " << (std::string)item.location << "\n";
+            ++stripped;
+            continue;
+        }
+
+        //arguments are always tuples
+        auto isArguments = ((List.type == InstructionType::Call && i == 1) || (List.type == InstructionType::Expression && i == 0));
+        if (collapseTuples && !isArguments && tuple != nullptr && tuple->size() == 1)
+        {
+            if (dump != nullptr)
+                *dump << "collapse tuple @ " << (std::string)item.location << "\n";
+            item = tuple->front();
+            ++collapsed;
+        }
+
+        items[count++] = item;
+    }
+
+    if (count < items.size())
+        List.value = TList(items.begin(), count);
+}
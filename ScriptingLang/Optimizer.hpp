@@ -0,0 +1,40 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Instruction.hpp"
+#include "Construct.hpp"
+
+namespace Plang
+{
+    //An optional pass over a parsed tree (run after Parser::Parse) that:
+    //  folds built in operators on literals ( 3 + 5.0 * 4 -> 23.0 ), unless the operator is defined in scope or its name is used as a value
+    //  collapses single item tuples (except argument tuples)
+    //  strips empty statements
+    //Deferred expression bodies are left as they are
+    class Optimizer
+    {
+    public:
+        Optimizer(const Construct& Scope) : arena(std::make_shared<Arena>()), scope(Scope) { }
+
+        bool foldConstants = true;
+        bool collapseTuples = true;
+        bool stripEmptyStatements = true;
+        std::ostream* dump = nullptr; //if set, each change is described here (for debugging)
+
+        void Optimize(Instruction& Root); //optimize a tree in place
+
+        std::shared_ptr<Arena> arena; //holds folded strings. Must be kept with the tree
+
+        size_t folded = 0;
+        size_t collapsed = 0;
+        size_t stripped = 0;
+
+    protected:
+        const Construct& scope;
+        std::unordered_map<SymbolId, bool> foldable; //operators that are known to be built in
+
+        void FindValueUses(const Instruction& Root); //operators used as values (e.g. assigned or passed) are not foldable
+        bool TryFold(Instruction& Call);
+        void Simplify(Instruction& List); //collapse and strip the items of a list
+    };
+};
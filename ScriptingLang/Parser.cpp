@@ -1,447 +1,683 @@
 #include "pch.hpp"
 #include "Parser.hpp"
 #include "StringOps.hpp"
+#include <mutex>
 
 using namespace Plang;
 
-std::set<std::string> Parser::postfixOperators
+Instruction Parser::Close()
 {
-    "++", "--",
-};
-std::set<std::string> Parser::prefixOperators
+    auto frame = frames.back();
+    Instruction instruction(frame.type, arena->Copy(pending.data() + frame.start, pending.size() - frame.start));
+    instruction.location = frame.location;
+
+    pending.resize(frame.start);
+    frames.pop_back();
+    return instruction;
+}
+
+void Parser::CloseStatement()
 {
-    "++", "--", "!", "+", "-", "~", "="
-};
-std::map<std::string, BinaryOperator> Parser::infixOperators
+    auto& frame = Top();
+    auto instruction = Evaluate(TList(pending.data() + frame.start, pending.size() - frame.start), Operators(frame.location.module));
+
+    pending.resize(frame.start);
+    frames.pop_back();
+    if (instruction.type != InstructionType::Statement && instruction.type != InstructionType::Unknown) //empty and invalid statements are removed
+        AddChild(instruction);
+}
+
+void Parser::CloseFrames(size_t count)
 {
-    { "*", BinaryOperator("*", Association::LeftToRight, 3) },
-    { "/", BinaryOperator("/", Association::LeftToRight, 3) },
-    { "/", BinaryOperator("%", Association::LeftToRight, 3) },
+    while (frames.size() > count)
+    {
+        auto& frame = Top();
+        if (frame.type == InstructionType::Statement)
+            CloseStatement();
+        else
+        {
+            if (frame.type == InstructionType::List)
+                AddError(ParserError::MissingClose, frame.location, { "[" });
+            else if (frame.type == InstructionType::Block)
+                AddError(ParserError::MissingClose, frame.location, { "{" });
+            else if (frame.type == InstructionType::Tuple)
+                AddError(ParserError::MissingClose, frame.location, { "(" });
+            AddChild(Close());
+        }
+    }
+}
 
-    { "+", BinaryOperator("+", Association::LeftToRight, 4) },
-    { "-", BinaryOperator("-", Association::LeftToRight, 4) },
+void Parser::CloseAll()
+{
+    CloseFrames(1);
+    root = Close();
+}
 
-    { "<<", BinaryOperator("<<", Association::LeftToRight, 5) },
-    { ">>", BinaryOperator(">>", Association::LeftToRight, 5) },
+ReportTypeId Parser::ReportType(ParserError Error)
+{
+    static const auto types = []()
+    {
+        std::array<ReportTypeId, (size_t)ParserError::Count> types;
+        auto add = [&](ParserError error, const std::string& description)
+        {
+            types[(size_t)error] = ReportLog::RegisterType({ ReportLevel::Error, ReportSeverity::Severe, description });
+        };
+
+        add(ParserError::TooManyOperands, "Too many operands ($1)");
+        add(ParserError::InvalidOperator, "Invalid operator ($1)");
+        add(ParserError::InvalidNumber, "Invalid number ($1)");
+        add(ParserError::MissingClose, "Missing closing bracket ($1)");
+        add(ParserError::MismatchedClose, "Mismatched closing bracket ($1)");
+        add(ParserError::EmptyValue, "$2 cannot have empty values ($1)");
+        add(ParserError::InvalidSeparator, "Invalid separator, must be in list or tuple ($1)");
+        add(ParserError::UnknownSeparator, "Unknown separator ($1)");
+        add(ParserError::UnknownTerminator, "Unknown terminator ($1)");
+        add(ParserError::InvalidDeclaration, "Invalid operator declaration ($1)");
+        add(ParserError::InvalidNotation, "Operator notation must be prefix, infix, or postfix ($1)");
+        add(ParserError::InvalidAssociation, "Operator association must be left or right ($1)");
+        add(ParserError::InvalidPrecedence, "Operator precedence must be a positive integer ($1)");
+        add(ParserError::IncompleteDeclaration, "Incomplete operator declaration ($1)");
+        return types;
+    }();
+    return types[(size_t)Error];
+}
 
-    { "<", BinaryOperator("<", Association::LeftToRight, 6) },
-    { "<=", BinaryOperator("<=", Association::LeftToRight, 6) },
-    { ">=", BinaryOperator(">=", Association::LeftToRight, 6) },
-    { ">", BinaryOperator(">", Association::LeftToRight, 6) },
+void Parser::AddError(ParserError error, const Location& location, std::initializer_list<std::string_view> arguments)
+{
+    errors.push_back({ ReportType(error), location, ::Array<std::string>(arguments.size()) });
+    std::copy(arguments.begin(), arguments.end(), errors.back().arguments.Data());
+    ReportLog::AddReport(errors.back());
+}
 
-    { "==", BinaryOperator("==", Association::LeftToRight, 7) },
-    { "!=", BinaryOperator("!=", Association::LeftToRight, 7) },
+void Parser::Recover()
+{
+    while (Top().type == InstructionType::Accessor)
+        frames.pop_back();
+    if (Top().type == InstructionType::Statement)
+        pending.resize(Top().start);
 
-    { "&", BinaryOperator("&", Association::LeftToRight, 8) },
+    recovering = true;
+    recoveryDepth = 0;
+}
 
-    { "^", BinaryOperator("^", Association::LeftToRight, 9) },
+bool Parser::Resync(const LexerToken& token)
+{
+    switch (token.type)
+    {
+    case LexerTokenType::ListOpen:
+    case LexerTokenType::BlockOpen:
+    case LexerTokenType::TupleOpen:
+        ++recoveryDepth;
+        return false;
 
-    { "|", BinaryOperator("|", Association::LeftToRight, 10) },
+    //the statement ends at a terminator or when the bracket it is in closes
+    case LexerTokenType::ListClose:
+    case LexerTokenType::BlockClose:
+    case LexerTokenType::TupleClose:
+        if (recoveryDepth > 0)
+        {
+            --recoveryDepth;
+            return false;
+        }
+        break;
+    case LexerTokenType::Terminator:
+        if (recoveryDepth > 0)
+            return false;
+        break;
 
-    { "&&", BinaryOperator("&&", Association::LeftToRight, 11) },
+    default:
+        return false;
+    }
 
-    { "||", BinaryOperator("!=", Association::LeftToRight, 12) },
+    recovering = false;
+    return true;
+}
 
-    { ":", BinaryOperator(":", Association::RightToLeft, 14) },
-    { "=", BinaryOperator("=", Association::RightToLeft, 14) },
-    //todo: other assignments
-};
+bool Parser::CanDefer(const LexerToken& token) const
+{
+    //the body must follow the arguments tuple, and must be parsed with the built in operators
+    return (frames.back().type == InstructionType::Statement &&
+            previousType == LexerTokenType::TupleClose &&
+            ChildCount() > 0 && pending.back().type == InstructionType::Tuple &&
+            declaredOperators.find(token.module) == declaredOperators.end() &&
+            !Modules::Source(token.module).empty());
+}
 
-void Parser::Reparent(Instruction& node, const NonOwningRef<Instruction>& parent)
+void Parser::SkipDeferred(const LexerToken& token)
 {
-    //todo: make stack based
-    node.parent = parent;
-    auto children = std::get_if<TList>(&node.value);
-    if (children != nullptr)
+    deferred.tokens.push_back(token);
+    switch (token.type)
     {
-        for (auto& i : *children)
-            Reparent(i, &node);
+    case LexerTokenType::ListOpen:
+    case LexerTokenType::BlockOpen:
+    case LexerTokenType::TupleOpen:
+        deferred.brackets.push_back(token.type);
+        return;
+
+    case LexerTokenType::ListClose:
+    case LexerTokenType::BlockClose:
+    case LexerTokenType::TupleClose:
+    {
+        //mismatched brackets are parsed now so that they are reported and recovered from as usual
+        //(each closing bracket type follows its opening bracket type)
+        auto open = (deferred.brackets.empty() ? LexerTokenType::BlockOpen : deferred.brackets.back());
+        if ((LexerTokenType)((int)open + 1) != token.type)
+        {
+            ParseSkipped();
+            return;
+        }
+        if (!deferred.brackets.empty())
+        {
+            deferred.brackets.pop_back();
+            return;
+        }
+        break;
     }
-}
 
-//add this node to the current parent
-Instruction& Parser::AddChild(const Instruction& instruction)
-{
-    auto& list = parent->As<Instructions::List>();
-    list.Add(instruction);
-    list.Last().parent = parent;
-    return list.Last();
+    //declarations apply to everything after them
+    case LexerTokenType::Identifier:
+        if (TokenText(token) == "#operator")
+            ParseSkipped();
+        return;
+
+    default:
+        return;
+    }
+
+    deferred.active = false;
+    auto& body = AddChild(Instruction(InstructionType::Deferred, (TInt)(((uint64_t)Modules::Revision(token.module) << 32) | token.offset)));
+    body.location = deferred.open.Locate();
 }
 
-Instruction& Parser::AddStatement(InstructionType parentType)
+void Parser::ParseSkipped()
 {
-    parent = AddChild(Instruction(parentType, TList()));
-    return AddChild(Instruction(InstructionType::Statement, TList()));
+    auto tokens = std::move(deferred.tokens);
+    deferred.active = false;
+    deferred.tokens.clear();
+
+    Open(InstructionType::Block, deferred.open.Locate());
+    Open(InstructionType::Statement, deferred.open.Locate());
+    previousType = LexerTokenType::BlockOpen;
+    for (auto& token : tokens)
+    {
+        ParseNext(token);
+        previousType = token.type;
+    }
 }
 
-Instruction* Parser::LastInstruction()
+namespace Plang
 {
-    auto& list = parent->As<Instructions::List>();
-    return (list.Count() > 0 ? &list.Last() : nullptr);
+    //The deferred bodies of a module revision that have been parsed, by the offset of their opening bracket
+    struct DeferredBodies
+    {
+        struct Body
+        {
+            Instruction block;
+            std::string error;
+        };
+        std::unordered_map<uint32_t, Body> bodies;
+        std::shared_ptr<Arena> arena = std::make_shared<Arena>(); //shared by the bodies (and with the scripts using them)
+    };
 }
 
-bool Parser::IsPunctuation(InstructionType instruction) const
+Instruction Parser::ParseDeferred(const Instruction& Deferred, std::shared_ptr<const void>& Owner)
 {
-    switch (instruction)
-    {
-    case InstructionType::Accessor:
-    case InstructionType::List:
-    case InstructionType::Block:
-    case InstructionType::Tuple:
-    case InstructionType::Program:
-    case InstructionType::Statement:
-        return true;
-    default:
-        return false;
+    //bodies may be parsed by scripts on several threads. Never destroyed, so that it can be used during exit
+    static auto mutex = new std::mutex;
+    std::lock_guard<std::mutex> lock(*mutex);
+
+    auto& location = Deferred.location;
+    auto value = (uint64_t)std::get<TInt>(Deferred.value);
+    auto close = (uint32_t)value;
+    if (location.module >= Modules::Count() || (uint32_t)(value >> 32) != Modules::Revision(location.module))
+        throw "Deferred body is out of date @ " + (std::string)location;
+
+    auto& state = Modules::Deferred(location.module);
+    if (state == nullptr)
+        state = std::make_shared<DeferredBodies>();
+    auto found = state->bodies.find(location.offset);
+    if (found == state->bodies.end())
+    {
+        if (close <= location.offset || close >= Modules::Source(location.module).length())
+            throw "Invalid deferred body @ " + (std::string)location;
+
+        Lexer lexer(location.module, location.offset + 1, close - location.offset - 1, LexerTokenType::BlockOpen);
+        Parser parser;
+        parser.deferBodies = true;
+        parser.arena = state->arena;
+
+        DeferredBodies::Body body;
+        if (!parser.Parse(lexer))
+            body.error = ReportLog::Format(parser.errors.front()) + " @ " + (std::string)parser.errors.front().location;
+        body.block = Instruction(InstructionType::Block, parser.root.value);
+        body.block.location = location;
+        found = state->bodies.emplace(location.offset, body).first;
     }
+
+    if (!found->second.error.empty())
+        throw found->second.error;
+    Owner = state->arena;
+    return found->second.block;
 }
 
 Parser::Parser()
+    : arena(std::make_shared<Arena>())
 {
     root = Plang::Instruction(InstructionType::Program, TList());
-    parent = &root;
 }
 
-void Parser::Parse(const Lexer::TokenList& tokens, bool failOnFirstError)
+OperatorTable& Parser::Operators(ModuleId Module)
 {
-    if (tokens.size() < 1)
-        return;
-
-    parent = &AddChild(Instruction(InstructionType::Statement, TList()));
+    auto found = operators.find(Module);
+    if (found == operators.end())
+        found = operators.emplace(Module, OperatorTable::Default()).first;
+    return found->second;
+}
 
-    size_t errorCount = 0;
+template <typename TNextToken>
+bool Parser::ParseTokens(TNextToken NextToken, bool failOnFirstError)
+{
+    errors.clear();
+    auto token = NextToken();
+    if (token == nullptr)
+        return true;
 
-    for (auto it = tokens.cbegin(); it != tokens.cend(); ++it)
+    //continue after the statements of any previous parses
+    auto& statements = std::get<TList>(root.value);
+    pending.assign(statements.begin(), statements.end());
+    if (root.location.module == NoModule)
+        root.location = token->Locate(); //the program starts at its first token (used in errors about the whole program)
+    frames.assign(1, { InstructionType::Program, root.location, 0 });
+    declaration.clear();
+    deferred.active = false;
+    recovering = false;
+    Open(InstructionType::Statement, token->Locate());
+
+    LexerToken lastToken;
+    for (; token != nullptr; token = NextToken())
     {
-        try
-        {
-            ParseNext(it, tokens);
-        }
-        catch (const EParser& e)
-        {
-            if (++errorCount > 0 && failOnFirstError)
-                break;
+        lastToken = *token;
+        ParseNext(*token);
+        previousType = token->type;
 
-            //todo: store exceptions
-            std::cerr << "! " << e.Severity() << ": " << e.what() << " (" << e.token << ") @ " << e.location << "\n";
-        }
+        if (failOnFirstError && !errors.empty())
+            break;
     }
 
-    if (parent->type == InstructionType::Accessor)
-        parent = parent->parent;
+    if (deferred.active)
+        ParseSkipped(); //the body is missing its closing bracket
+
+    if (Top().type == InstructionType::Accessor)
+        AddChild(Close());
+
+    if (!declaration.empty())
+    {
+        auto location(lastToken.Locate());
+        location.offset += lastToken.length;
+        AddError(ParserError::IncompleteDeclaration, location, { "#operator" });
+        declaration.clear();
+    }
+
+    //unclosed brackets are left in the tree
+    CloseAll();
+    return errors.empty();
+}
+
+bool Parser::Parse(Lexer& lexer, bool failOnFirstError)
+{
+    LexerToken token;
+    this->lexer = &lexer;
+    return ParseTokens([&]() { return lexer.NextToken(token) ? &token : nullptr; }, failOnFirstError);
+}
+
+bool Parser::Parse(const Lexer::TokenList& tokens, bool failOnFirstError)
+{
+    auto it = tokens.begin();
+    lexer = nullptr;
+    return ParseTokens([&]() { return it != tokens.end() ? &*it++ : nullptr; }, failOnFirstError);
+}
 
-    parent = parent->parent;
-    if (parent != root)
+void Parser::ParseClose(const LexerToken& token, InstructionType type)
+{
+    //stray closing brackets are ignored
+    auto match = frames.size() - 1;
+    while (match > 0 && frames[match].type != type)
+        --match;
+    if (match == 0)
     {
-        auto loc(tokens.back().location);
-        ++loc.column;
-        throw EParserError("Unmatched )]}", LexerToken(LexerTokenType::Invalid, "", loc)); //todo
+        AddError(ParserError::MismatchedClose, token);
+        return;
     }
 
-    auto& list = root.As<Instructions::List>();
-    if (list.Count() > 0)
-        EvaluateStatement(list.Last());
+    //anything opened since the bracket is missing its closing bracket
+    CloseFrames(match + 1);
+    AddChild(Close());
 }
 
-void Parser::ParseNext(Lexer::TokenList::const_iterator& token, const Lexer::TokenList& allTokens) //todo: allTokens may not be necessary
+void Parser::ParseNext(const LexerToken& token)
 {
-    if (parent->type == InstructionType::Accessor &&
-        token->type != LexerTokenType::Accessor &&
-        (token - 1)->type != LexerTokenType::Accessor)
-        parent = parent->parent;
+    if (deferred.active)
+    {
+        SkipDeferred(token);
+        return;
+    }
+
+    if (recovering && !Resync(token))
+        return;
+
+    if (!declaration.empty())
+    {
+        ParseDeclaration(token);
+        return;
+    }
 
-    switch (token->type)
+    if (Top().type == InstructionType::Accessor &&
+        token.type != LexerTokenType::Accessor &&
+        previousType != LexerTokenType::Accessor)
+        AddChild(Close());
+
+    switch (token.type)
     {
     case LexerTokenType::Number:
     {
-        auto number(ParseNumber(token->value));
+        auto number(ParseNumber(std::string(TokenText(token))));
+        if (number.type == InstructionType::Unknown)
+        {
+            AddError(ParserError::InvalidNumber, token);
+            Recover();
+            break;
+        }
+
+        number.location = token.Locate();
         AddChild(number);
         break;
     }
     case LexerTokenType::String:
     {
-        AddChild(Instruction(InstructionType::String, ParseString(token->value)));
+        AddChild(Instruction(InstructionType::String, arena->Copy(ParseString(std::string(TokenText(token)))))).location = token.Locate();
         break;
     }
     case LexerTokenType::Identifier:
     {
-        AddChild(Instruction(InstructionType::Identifier, token->value));
+        auto text = TokenText(token);
+        if (text == "#operator" && Top().type == InstructionType::Statement && ChildCount() == 0)
+        {
+            declaration.emplace_back(text);
+            break;
+        }
+
+        auto symbol = Symbols::Intern(text);
+        auto& identifier = AddChild(Instruction(InstructionType::Identifier, Symbols::Name(symbol)));
+        identifier.symbol = symbol;
+        identifier.location = token.Locate();
         break;
     }
     case LexerTokenType::Accessor:
     {
-        auto& list = parent->As<Instructions::List>();
-        if (parent->type != InstructionType::Accessor)
+        if (Top().type != InstructionType::Accessor)
         {
-            TList ax;
-            if (list.Count() > 0)
-            {
-                ax.push_back(list.Last());
-                list.Last() = Instruction(InstructionType::Accessor, ax);
-            }
-            else
-            {
-                ax.push_back(Instruction(InstructionType::Identifier, nullptr));
-                AddChild(Instruction(InstructionType::Accessor, ax));
-            }
-            Reparent(list.Last(), parent);
-            parent = &list.Last();
+            //the accessor takes the previous instruction as its first child
+            if (ChildCount() == 0)
+                AddChild(Instruction(InstructionType::Identifier, nullptr));
+            frames.push_back({ InstructionType::Accessor, pending.back().location, pending.size() - 1 });
         }
-        else if ((token - 1)->type == LexerTokenType::Accessor)
+        else if (previousType == LexerTokenType::Accessor)
         {
             //reflexive accessor, a..b
-            auto& list = parent->As<Instructions::List>();
-            list.Add(Instruction(InstructionType::Identifier, nullptr));
+            AddChild(Instruction(InstructionType::Identifier, nullptr));
         }
         break;
     }
     case LexerTokenType::ListOpen:
     {
-        parent = &AddStatement(InstructionType::List);
+        Open(InstructionType::List, token.Locate());
+        Open(InstructionType::Statement, token.Locate());
         break;
     }
     case LexerTokenType::BlockOpen:
     {
-        parent = &AddStatement(InstructionType::Block);
+        if (deferBodies && CanDefer(token))
+        {
+            deferred.active = true;
+            deferred.open = token;
+            deferred.brackets.clear();
+            deferred.tokens.clear();
+            break;
+        }
+
+        Open(InstructionType::Block, token.Locate());
+        Open(InstructionType::Statement, token.Locate());
         break;
     }
     case LexerTokenType::TupleOpen:
     {
-        parent = &AddStatement(InstructionType::Tuple);
+        Open(InstructionType::Tuple, token.Locate());
+        Open(InstructionType::Statement, token.Locate());
         break;
     }
     case LexerTokenType::ListClose:
     {
-        while (parent->parent != nullptr && !IsPunctuation(parent->type))
-            parent = parent->parent;
-
-        //todo: should always be statement?
-
-        if (parent->type == InstructionType::Statement)
-        {
-            EvaluateStatement(*parent);
-            parent = parent->parent;
-        }
-
-        if (parent->type != InstructionType::List)
-            throw EParserError("Mismatched ]", *token);
-
-        EvaluateStatement(*parent);
-        parent = parent->parent;
+        ParseClose(token, InstructionType::List);
         break;
     }
     case LexerTokenType::BlockClose:
     {
-        while (parent->parent != nullptr && !IsPunctuation(parent->type))
-            parent = parent->parent;
-
-        //todo: should always be statement?
-        if (parent->type == InstructionType::Statement)
-        {
-            EvaluateStatement(*parent);
-            parent = parent->parent;
-        }
-
-        if (parent->type != InstructionType::Block)
-            throw EParserError("Mismatched }", *token);
-
-        EvaluateStatement(*parent);
-        parent = parent->parent;
+        ParseClose(token, InstructionType::Block);
         break;
     }
     case LexerTokenType::TupleClose:
     {
-        while (parent->parent != nullptr && !IsPunctuation(parent->type))
-            parent = parent->parent;
-
-        //todo: should always be statement?
-        if (parent->type == InstructionType::Statement)
-        {
-            EvaluateStatement(*parent);
-            parent = parent->parent;
-        }
-
-        if (parent->type != InstructionType::Tuple)
-            throw EParserError("Mismatched )", *token);
-
-        EvaluateStatement(*parent);
-        parent = parent->parent;
+        ParseClose(token, InstructionType::Tuple);
         break;
     }
     case LexerTokenType::Separator:
     {
-        while (parent->parent != nullptr && !IsPunctuation(parent->type))
-            parent = parent->parent;
-
         //todo: assert list or tuple
-        if (parent->type != InstructionType::Statement)
-            throw EParserError("Unknown separator", *token);
+        if (Top().type != InstructionType::Statement)
+        {
+            AddError(ParserError::UnknownSeparator, token);
+            break;
+        }
 
-        if (parent->As<Instructions::List>().Count() == 0)
-            throw EParserError(parent->parent->TypeName() + " cannot have empty values", *token);
+        if (ChildCount() == 0)
+        {
+            AddError(ParserError::EmptyValue, token.Locate(), { TokenText(token), Instruction::TypeName(frames[frames.size() - 2].type) });
+            break;
+        }
 
-        EvaluateStatement(*parent);
-        parent = parent->parent;
+        CloseStatement();
+        Open(InstructionType::Statement, token.Locate());
 
-        switch (parent->type)
+        auto parent = frames[frames.size() - 2].type;
+        if (parent != InstructionType::List && parent != InstructionType::Tuple)
         {
-        case InstructionType::List:
-        case InstructionType::Tuple:
-            parent = &AddChild(Instruction(InstructionType::Statement, TList()));
-            break;
-        default:
-            throw EParserError("Invalid separator, must be in list or tuple", *token);
+            AddError(ParserError::InvalidSeparator, token);
+            Recover();
         }
 
         break;
     }
     case LexerTokenType::Terminator:
     {
-        while (parent->parent != nullptr && !IsPunctuation(parent->type))
-            parent = parent->parent;
-
         //special list/tuple parsing (2d arrays?)
 
-        if (parent->type != InstructionType::Statement)
-            throw EParserError("Unknown terminator", *token);
+        if (Top().type != InstructionType::Statement)
+        {
+            AddError(ParserError::UnknownTerminator, token);
+            break;
+        }
 
         //empty statement
-        if (parent->As<Instructions::List>().Count() == 0)
+        if (ChildCount() == 0)
             break;
 
-        EvaluateStatement(*parent);
-
-        parent = parent->parent;
-        parent = &AddChild(Instruction(InstructionType::Statement, TList()));
+        CloseStatement();
+        Open(InstructionType::Statement, token.Locate());
 
         break;
     }
     }
 }
 
-void Parser::EvaluateStatement(Instruction& statement)
+void Parser::ParseDeclaration(const LexerToken& token)
 {
-    if (statement.type != InstructionType::Statement)
+    //#operator name prefix|postfix precedence
+    //#operator name infix left|right precedence
+    auto fail = [&](ParserError error)
+    {
+        AddError(error, token);
+        declaration.clear();
+        Recover();
+
+        //the declaration may have been cut short by the end of the statement
+        if (Resync(token))
+            ParseNext(token);
+    };
+
+    auto& words = declaration;
+    bool isLast = (words.size() == 4 || (words.size() == 3 && words[2] != "infix"));
+    if (token.type != (isLast ? LexerTokenType::Number : LexerTokenType::Identifier))
+    {
+        fail(ParserError::InvalidDeclaration);
         return;
+    }
 
-    auto list = statement.As<Instructions::List>();
-    auto stmtParent = statement.parent;
+    words.emplace_back(TokenText(token));
+    if (words.size() == 3 && words[2] != "prefix" && words[2] != "infix" && words[2] != "postfix")
+    {
+        fail(ParserError::InvalidNotation);
+        return;
+    }
+    if (words.size() == 4 && words[2] == "infix" && words[3] != "left" && words[3] != "right")
+    {
+        fail(ParserError::InvalidAssociation);
+        return;
+    }
+    if (!isLast)
+        return;
 
-    if (list.Count() == 0)
+    auto precedence = ParseNumber(words.back());
+    if (precedence.type != InstructionType::Int || std::get<TInt>(precedence.value) < 0)
     {
-        stmtParent->As<Instructions::List>().Remove(statement);
+        fail(ParserError::InvalidPrecedence);
         return;
     }
 
-    std::stack<BinaryOperator> ops;
-    std::stack<Instruction> output;
+    auto notation = Notation::Infix;
+    auto association = (words[3] == "left" ? Association::LeftToRight : Association::RightToLeft);
+    if (words[2] == "prefix")
+    {
+        notation = Notation::Prefix;
+        association = Association::RightToLeft;
+    }
+    else if (words[2] == "postfix")
+    {
+        notation = Notation::Postfix;
+        association = Association::LeftToRight;
+    }
+
+    Operators(token.module).Define(Symbols::Intern(words[1]), notation, association, (unsigned)std::get<TInt>(precedence.value));
+    declaredOperators.insert(token.module);
+    declaration.clear();
+}
 
-    auto infix = [&]()
+//the operator an item names, if any
+static inline const Operator* FindOperator(const Instruction& item, Notation notation, const OperatorTable& operators)
+{
+    return (item.type == InstructionType::Identifier ? operators.Find(item.symbol, notation) : nullptr);
+}
+
+Instruction Parser::Evaluate(TList list, const OperatorTable& operators)
+{
+    if (list.size() == 0)
+        return Instruction(InstructionType::Statement);
+
+    size_t next = 0;
+    auto expression = ParseExpression(list, next, std::numeric_limits<unsigned>::max(), operators);
+    if (expression.type != InstructionType::Unknown && next < list.size())
     {
-		if (output.size() == 0)
-			output.push(Instruction(InstructionType::Identifier, ops.top().name));
-        else if (output.size() == 1)
-            throw EParserError("invalid operator", statement); //todo (should be operator location)
+        AddError(ParserError::TooManyOperands, list[next]);
+        return Instruction();
+    }
+    return expression;
+}
 
-		else
-		{
-			auto second = output.top(); output.pop();
-			auto first = output.top(); output.pop();
+Instruction Parser::ParseExpression(TList list, size_t& next, unsigned limit, const OperatorTable& operators)
+{
+    auto& first = list[next++];
+    Instruction left;
 
-			output.push(Instructions::Call(
-				Instruction(InstructionType::Identifier, ops.top().name),
-				{ TryCollapseTuple(first), TryCollapseTuple(second) }
-			));
-		}
-        ops.pop();
-    };
+    auto prefix = FindOperator(first, Notation::Prefix, operators);
+    if (prefix != nullptr && next < list.size())
+    {
+        auto operand = ParseExpression(list, next, prefix->precedence, operators);
+        if (operand.type == InstructionType::Unknown)
+            return operand;
+        left = Instructions::Call(*arena, first, { operand, Instruction() });
+    }
 
-    bool wasLastOp = false;
-    for (size_t i = 0; i < list.Count(); ++i)
+    //operators can be used as values on their own ( f(+) )
+    else if (next < list.size() && prefix == nullptr &&
+             (FindOperator(first, Notation::Infix, operators) != nullptr || FindOperator(first, Notation::Postfix, operators) != nullptr))
     {
-        auto str = std::get_if<std::string>(&list[i].value);
-        if (str != nullptr)
-        {
-            auto unaryFind(postfixOperators.find(*str));
-            if (unaryFind != postfixOperators.end() && !output.empty() && output.top().type != InstructionType::Unknown)
-            {
-                output.top() = Instructions::Call(list[i], { Instruction(), output.top() });
-                wasLastOp = true;
-                continue;
-            }
+        AddError(ParserError::InvalidOperator, first.location, { std::get<TString>(first.value) });
+        return Instruction();
+    }
 
-            unaryFind = prefixOperators.find(*str);
-            if (unaryFind != prefixOperators.end() && (i == 0 || (wasLastOp && i < list.Count() - 1)))
-            {
-				output.push(Instructions::Call(list[i], { list[i + 1], Instruction() }));
-				++i;
-                continue;
-            }
+    else
+        left = TryCollapseTuple(first); //todo: maybe collapse tuples in later pass (some places dont allow tuple collapse maybe)
 
-            auto binaryFind(infixOperators.find(*str));
-            if (binaryFind != infixOperators.end())
-            {
-                auto& op = binaryFind->second;
-                while (!ops.empty())
-                {
-                    auto& top = ops.top();
-                    if ((op.association == Association::LeftToRight && op.precedence >= top.precedence) ||
-                        (op.association == Association::RightToLeft && op.precedence > top.precedence))
-                        infix();
-                    else
-                        break;
-                }
-
-                ops.push(op);
-
-                wasLastOp = true;
-                continue;
-            }
-        }
+    while (next < list.size())
+    {
+        auto& item = list[next];
 
         //list accessor ( a[x] )
-        if (list[i].type == InstructionType::List && !output.empty())
+        if (item.type == InstructionType::List)
         {
-            auto& top = output.top();
-            list[i].As<Instructions::List>().Insert(top);
-            top = list[i];
-            top.type = InstructionType::Accessor;
+            auto& items = std::get<TList>(item.value);
+            auto accessor = arena->Allocate<Instruction>(items.size() + 1);
+            accessor[0] = left;
+            std::copy(items.begin(), items.end(), accessor.begin() + 1);
+
+            auto location = left.location;
+            left = Instruction(InstructionType::Accessor, accessor);
+            left.location = location;
         }
 
         //function call ( f() )
-        else if (list[i].type == InstructionType::Tuple && !output.empty() && !wasLastOp)
-        {
-            auto& top = output.top();
-            top = Instructions::Call(top, list[i]);
-        }
+        else if (item.type == InstructionType::Tuple)
+            left = Instructions::Call(*arena, left, item);
 
         //expression ( () { } )
-        else if (list[i].type == InstructionType::Block && !output.empty() && !wasLastOp)
-        {
-            auto& top = output.top();
-            top = Instructions::Expression(top, list[i]);
-        }
+        else if (item.type == InstructionType::Block || item.type == InstructionType::Deferred)
+            left = Instructions::Expression(*arena, left, item);
 
-        else
+        else if (auto postfix = FindOperator(item, Notation::Postfix, operators); postfix != nullptr && postfix->precedence < limit)
+            left = Instructions::Call(*arena, item, { Instruction(), left });
+
+        else if (auto infix = FindOperator(item, Notation::Infix, operators); infix != nullptr && infix->precedence < limit)
         {
-            output.push(TryCollapseTuple(list[i])); //todo: maybe collapse tuples in later pass (some places dont allow tuple collapse maybe)
-            wasLastOp = false;
+            if (++next == list.size())
+            {
+                AddError(ParserError::InvalidOperator, item.location, { std::get<TString>(item.value) });
+                return Instruction();
+            }
+
+            //operators of the same precedence are grouped to the left unless right associative
+            auto right = ParseExpression(list, next, infix->precedence + (infix->association == Association::RightToLeft ? 1 : 0), operators);
+            if (right.type == InstructionType::Unknown)
+                return right;
+            left = Instructions::Call(*arena, item, { left, right });
+            continue;
         }
-    }
 
-    while (!ops.empty())
-        infix();
+        else
+            break;
 
-	if (output.size() != 1)
-	{
-		std::cout << "!! ";
-		for (const auto& o : *((std::deque<Instruction>*)&output))
-			std::cout << ">> " << o;
-		throw EParserError("Too many operands", output.top());
-	}
-    statement = output.top();
+        ++next;
+    }
 
-    Reparent(statement, stmtParent);
+    return left;
 }
 
 Instruction Parser::ParseNumber(std::string input)
@@ -452,19 +688,34 @@ Instruction Parser::ParseNumber(std::string input)
     auto baseOffset = input.find_last_of('_');
     if (baseOffset != std::string::npos)
     {
-        auto baseStr = input.substr(baseOffset + 1);
+        char* end;
+        auto baseStr = input.c_str() + baseOffset + 1;
+        base = (int)std::strtol(baseStr, &end, 10);
+        if (end == baseStr || base < 2 || base > 36)
+            return Instruction();
         input.resize(baseOffset);
-        base = std::stoi(baseStr);
     }
     else if (StringOps::StartsWith(input, "0x"))
         base = 16;
 
     //todo: handle invalid numbers: 0xff_8; 99_8;
 
+    char* end;
+    errno = 0;
     if (input.find('.') != input.npos)
-        return { InstructionType::Float, std::stod(input) };
+    {
+        auto value = std::strtod(input.c_str(), &end);
+        if (end == input.c_str() || errno == ERANGE)
+            return Instruction();
+        return { InstructionType::Float, value };
+    }
     else
-        return { InstructionType::Int, std::stoll(input, nullptr, base) };
+    {
+        auto value = std::strtoll(input.c_str(), &end, base);
+        if (end == input.c_str() || errno == ERANGE)
+            return Instruction();
+        return { InstructionType::Int, (TInt)value };
+    }
 }
 
 std::string Parser::ParseString(std::string Input)
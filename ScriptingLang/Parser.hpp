@@ -3,97 +3,103 @@
 #include "pch.hpp"
 #include "Lexer.hpp"
 #include "Instruction.hpp"
+#include "Operator.hpp"
+#include "ReportLog.hpp"
 
 namespace Plang
 {
-    enum class Association
+    //Errors reported by the parser. Each has its own report type, with the offending token as the first argument
+    enum class ParserError
     {
-        None,
-        LeftToRight,
-        RightToLeft
-    };
-    struct BinaryOperator
-    {
-        std::string name;
-        Association association;
-        unsigned precedence; //lower numbers = higher precedence
-
-        BinaryOperator(const std::string& name, Association association, unsigned precedence)
-            : name(name), association(association), precedence(precedence) { }
+        TooManyOperands,
+        InvalidOperator,
+        InvalidNumber,
+        MissingClose,
+        MismatchedClose,
+        EmptyValue, //the second argument is the type of the list
+        InvalidSeparator,
+        UnknownSeparator,
+        UnknownTerminator,
+        InvalidDeclaration,
+        InvalidNotation,
+        InvalidAssociation,
+        InvalidPrecedence,
+        IncompleteDeclaration,
+
+        Count
     };
 
-    class EParser : public std::exception
+    class Parser
     {
     public:
-        EParser(const std::string& message, const LexerToken& token)
-            : message(message), token(token.value), location(token.location)
-        {
-        }
-        EParser(const std::string& message, const Instruction& instruction)
-            : message(message), token(instruction.TypeName()), location(instruction.location)
-        {
-        }
-
-        virtual const std::string Severity() const = 0;
-
-        const std::string token;
-        const Location location;
-        const std::string message;
+        Parser();
 
-        inline virtual const char* what() const noexcept override
-        {
-            return message.c_str();
-        }
-    };
-    class EParserWarning : public EParser
-    {
-    public:
-        EParserWarning(const std::string& message, const LexerToken& token)
-            : EParser(message, token) { }
-        EParserWarning(const std::string& message, const Instruction& instruction)
-            : EParser(message, instruction) { }
+        //Parsing does not stop at syntax errors. Errors are collected and the parser skips to the end of the statement,
+        //leaving out anything it could not parse. Returns false if there were any errors
+        bool Parse(Lexer& lexer, bool failOnFirstError = false); //parse tokens as they are read from the lexer
+        bool Parse(const Lexer::TokenList& tokens, bool failOnFirstError = false);
 
-        const std::string Severity() const override { return "Warning"; }
-    };
-    class EParserError : public EParser
-    {
-    public:
-        EParserError(const std::string& message, const LexerToken& token)
-            : EParser(message, token) { }
-        EParserError(const std::string& message, const Instruction& instruction)
-            : EParser(message, instruction) { }
+        Instruction root;
+        std::shared_ptr<Arena> arena; //holds all of the parsed instructions. Shared with anything that keeps the tree after the parser
 
-        const std::string Severity() const override { return "Error"; }
-    };
+        std::vector<Report> errors; //errors from the last parse (these are also added to the ReportLog)
+        static ReportTypeId ReportType(ParserError Error);
 
-    class Parser
-    {
-    public:
-        Parser();
-        Parser(const Parser& Parser)
-            : root(Parser.root)
-        {
-            Reparent(root, nullptr);
-        }
-        ~Parser() = default;
+        //the operators of a module, starting with the built in operators. #operator declarations in the module add to these
+        OperatorTable& Operators(ModuleId Module);
 
-        void Parse(const Lexer::TokenList& tokens, bool failOnFirstError = false);
+        //Only match the brackets of expression bodies ( (args) { ... } ), leaving them to be parsed when they are first evaluated (see ParseDeferred).
+        //The module's source must be kept while the tree is used. Bodies are not deferred in modules that declare operators before them
+        bool deferBodies = false;
 
-        Instruction root;
+        //Parse a deferred body into a block, setting Owner to keep it alive. Each body is only parsed once (per revision of its module).
+        //Throws if the body has syntax errors, or its module was edited after it was deferred
+        static Instruction ParseDeferred(const Instruction& Deferred, std::shared_ptr<const void>& Owner);
 
-        static Instruction ParseNumber(std::string Input);
+        static Instruction ParseNumber(std::string Input); //returns an Unknown instruction if the number is invalid
         static std::string ParseString(std::string Input);
 
     protected:
-        void ParseNext(Lexer::TokenList::const_iterator& token, const Lexer::TokenList& list);
-        void EvaluateStatement(Instruction& instruction);
-
-        void Reparent(Instruction& instruction, const NonOwningRef<Instruction>& parent);
-        Instruction& AddChild(const Instruction& instruction);
-        Instruction& AddStatement(InstructionType parentType);
-        Instruction* LastInstruction();
-
-        bool IsPunctuation(InstructionType instruction) const;
+        //an instruction whose children are still being parsed. Its children are at the end of `pending`
+        struct Frame
+        {
+            InstructionType type;
+            Location location;
+            size_t start; //index of the first child in pending
+        };
+
+        template <typename TNextToken>
+        bool ParseTokens(TNextToken NextToken, bool failOnFirstError); //NextToken returns a pointer to the next token or null at the end of the input
+        void ParseNext(const LexerToken& token);
+
+        //token text comes from the lexer being parsed (if any) since streamed sources are not kept
+        std::string_view TokenText(const LexerToken& token) const { return lexer != nullptr ? lexer->Text(token) : token.Text(); }
+
+        void AddError(ParserError error, const Location& location, std::initializer_list<std::string_view> arguments);
+        inline void AddError(ParserError error, const LexerToken& token) { AddError(error, token.Locate(), { TokenText(token) }); }
+        inline void AddError(ParserError error, const Instruction& instruction) { AddError(error, instruction.location, { instruction.TypeName() }); }
+
+        bool CanDefer(const LexerToken& token) const; //can the body opened by a token be deferred
+        void SkipDeferred(const LexerToken& token); //match the brackets of a deferred body
+        void ParseSkipped(); //parse the skipped tokens of a body that could not be deferred
+
+        void Recover(); //drop the statement being parsed and skip to its end
+        bool Resync(const LexerToken& token); //while recovering, returns true if the token ends the skipped statement
+
+        //These return an Unknown instruction (and add an error) if the items are not a valid expression
+        Instruction Evaluate(TList statement, const OperatorTable& operators); //turn the items of a statement into a single instruction
+        Instruction ParseExpression(TList items, size_t& next, unsigned limit, const OperatorTable& operators); //parse items joined by operators with a precedence below limit
+        void ParseDeclaration(const LexerToken& token); //add a token to the #operator declaration being parsed
+        void ParseClose(const LexerToken& token, InstructionType type); //close the innermost open bracket of a type
+        void CloseStatement(); //evaluate the statement at the top of the stack and add it to its parent (if not empty or invalid)
+
+        inline Frame& Top() { return frames.back(); }
+        inline size_t ChildCount() const { return pending.size() - frames.back().start; }
+        inline Instruction& AddChild(const Instruction& instruction) { pending.push_back(instruction); return pending.back(); }
+        inline void Open(InstructionType type, const Location& location) { frames.push_back({ type, location, pending.size() }); }
+        Instruction Close(); //finish the instruction at the top of the stack, moving its children into the arena
+        void CloseFrames(size_t count); //close instructions until count are open. Open brackets are reported as unclosed
+        void CloseAll(); //close any open instructions into the root
 
         const Instruction& TryCollapseTuple(const Instruction& instruction) const
         {
@@ -106,12 +112,25 @@ namespace Plang
             return instruction;
         }
 
-        NonOwningRef<Instruction> parent;
+        std::vector<Frame> frames;
+        std::vector<Instruction> pending;
+        LexerTokenType previousType = LexerTokenType::Invalid; //the type of the last parsed token
+        const Lexer* lexer = nullptr; //the lexer currently being parsed
+
+        std::unordered_map<ModuleId, OperatorTable> operators;
+        std::vector<std::string> declaration; //the words of a #operator declaration being parsed (empty if none)
+        std::unordered_set<ModuleId> declaredOperators; //modules with #operator declarations
 
-        static std::set<std::string> prefixOperators;
-        static std::set<std::string> postfixOperators;
-        static std::map<std::string, BinaryOperator> infixOperators;
+        //the expression body being skipped
+        struct
+        {
+            bool active = false;
+            LexerToken open;
+            std::vector<LexerTokenType> brackets; //brackets opened in the body
+            std::vector<LexerToken> tokens; //tokens skipped so far, parsed if the body cannot be deferred
+        } deferred;
+
+        bool recovering = false; //skipping tokens after an error
+        size_t recoveryDepth = 0; //brackets opened while recovering
     };
 };
-
-//todo: operators should use map<name, map<notation, op>>
@@ -0,0 +1,314 @@
+#include "pch.hpp"
+#include "ProgramCache.hpp"
+#include "MappedFile.hpp"
+#include "Module.hpp"
+#include "Lexer.hpp"
+#include "Parser.hpp"
+
+using namespace Plang;
+
+static_assert(std::is_trivially_copyable<Instruction>::value, "Instructions are stored in cache files as they are in memory");
+
+namespace
+{
+    //Instructions are stored as they are in memory, except that:
+    //  lists point to the index of their first item (items always come after the list, so there are no cycles)
+    //  strings point to an offset in the string data
+    //  symbols are indices into the symbol table
+    //  locations in the cached module have a module of 0 (any other module is not kept)
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t instructionSize; //the layout of instructions depends on the build
+        uint32_t symbolCount;
+        uint64_t sourceHash;
+        uint64_t sourceLength;
+
+        uint64_t instructions; //file offset of the instructions. The first is the root
+        uint64_t instructionCount;
+        uint64_t symbols; //file offset of the symbol table
+        uint64_t lines; //file offset of the line index
+        uint64_t lineCount;
+        uint64_t strings; //file offset of the string data
+        uint64_t stringsLength;
+    };
+
+    constexpr char magic[4] = { 'P', 'L', 'G', 'C' };
+
+    struct SymbolEntry
+    {
+        uint64_t offset; //in the string data
+        uint64_t length;
+    };
+
+    inline uint64_t Align(uint64_t Offset, uint64_t Alignment) { return (Offset + Alignment - 1) / Alignment * Alignment; }
+
+    //Flattens an instruction tree into the cache format
+    class Writer
+    {
+    public:
+        Writer(ModuleId Module) : module(Module) { }
+
+        void Write(const Instruction& Root)
+        {
+            //breadth first (trees can be too deep to recurse), so the items of each list are contiguous and after the list
+            instructions.assign(1, Root);
+            for (size_t i = 0; i < instructions.size(); ++i)
+            {
+                auto& instruction = instructions[i];
+                instruction.location.module = (instruction.location.module == module ? 0 : NoModule);
+                if (instruction.symbol != NoSymbol)
+                    instruction.symbol = AddSymbol(instruction.symbol);
+
+                if (auto list = std::get_if<TList>(&instruction.value))
+                {
+                    auto items = *list;
+                    instruction.value = TList(reinterpret_cast<Instruction*>(instructions.size()), items.size());
+                    instructions.insert(instructions.end(), items.begin(), items.end()); //invalidates instruction
+                }
+                else if (auto string = std::get_if<TString>(&instruction.value))
+                    instruction.value = TString(reinterpret_cast<const char*>(AddString(*string)), string->length());
+            }
+        }
+
+        std::vector<Instruction> instructions;
+        std::vector<SymbolEntry> symbols;
+        std::string strings;
+
+    protected:
+        uint64_t AddString(std::string_view String)
+        {
+            auto found = stringOffsets.find(String);
+            if (found != stringOffsets.end())
+                return found->second;
+
+            auto offset = (uint64_t)strings.length();
+            strings.append(String);
+            stringOffsets.emplace(String, offset);
+            return offset;
+        }
+
+        SymbolId AddSymbol(SymbolId Symbol)
+        {
+            auto found = symbolIndices.find(Symbol);
+            if (found != symbolIndices.end())
+                return found->second;
+
+            auto name = Symbols::Name(Symbol);
+            auto index = (SymbolId)symbols.size();
+            symbols.push_back({ AddString(name), name.length() });
+            symbolIndices.emplace(Symbol, index);
+            return index;
+        }
+
+        ModuleId module;
+        std::unordered_map<std::string_view, uint64_t> stringOffsets; //views of the strings in the tree being written
+        std::unordered_map<SymbolId, SymbolId> symbolIndices;
+    };
+}
+
+uint64_t ProgramCache::Hash(std::string_view Source)
+{
+    //FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (auto ch : Source)
+    {
+        hash ^= (unsigned char)ch;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+bool ProgramCache::Save(const std::string& CachePath, std::string_view Source, ModuleId Module, const Instruction& Root)
+{
+    Writer writer(Module);
+    writer.Write(Root);
+
+    auto& lines = Modules::LineStarts(Module);
+
+    Header header { };
+    std::copy(std::begin(magic), std::end(magic), header.magic);
+    header.version = Version;
+    header.instructionSize = sizeof(Instruction);
+    header.symbolCount = (uint32_t)writer.symbols.size();
+    header.sourceHash = Hash(Source);
+    header.sourceLength = Source.length();
+
+    header.instructions = Align(sizeof(Header), alignof(Instruction));
+    header.instructionCount = writer.instructions.size();
+    header.symbols = Align(header.instructions + writer.instructions.size() * sizeof(Instruction), alignof(SymbolEntry));
+    header.lines = Align(header.symbols + writer.symbols.size() * sizeof(SymbolEntry), alignof(uint32_t));
+    header.lineCount = lines.size();
+    header.strings = header.lines + lines.size() * sizeof(uint32_t);
+    header.stringsLength = writer.strings.length();
+
+    std::string data(header.strings + header.stringsLength, '\0');
+    memcpy(&data[0], &header, sizeof(Header));
+    memcpy(&data[header.instructions], writer.instructions.data(), writer.instructions.size() * sizeof(Instruction));
+    memcpy(&data[header.symbols], writer.symbols.data(), writer.symbols.size() * sizeof(SymbolEntry));
+    memcpy(&data[header.lines], lines.data(), lines.size() * sizeof(uint32_t));
+    memcpy(&data[header.strings], writer.strings.data(), writer.strings.length());
+
+    //write to a temporary file first so that other processes never see a partial cache
+    auto temporary = CachePath + "." + std::to_string(std::random_device()()) + ".tmp";
+    {
+        std::ofstream fout(temporary, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!fout.write(data.data(), data.length()))
+        {
+            fout.close();
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+
+#ifdef _WIN32
+    std::remove(CachePath.c_str()); //rename does not replace existing files
+#endif
+    if (std::rename(temporary.c_str(), CachePath.c_str()) != 0)
+    {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool ProgramCache::Load(const std::string& CachePath, const std::string& ModuleName, std::string_view Source, Program& Program)
+{
+    auto file = std::make_shared<MappedFile>();
+    if (!file->Open(CachePath, true) || file->Length() < sizeof(Header))
+        return false;
+
+    Header header;
+    memcpy(&header, file->Data(), sizeof(Header));
+    if (!std::equal(std::begin(magic), std::end(magic), header.magic) ||
+        header.version != Version ||
+        header.instructionSize != sizeof(Instruction) ||
+        header.sourceLength != Source.length() ||
+        header.sourceHash != Hash(Source))
+        return false;
+
+    //the sections must be inside the file
+    auto length = (uint64_t)file->Length();
+    auto fits = [&](uint64_t offset, uint64_t count, size_t size, size_t alignment)
+    {
+        return (offset % alignment == 0 && offset <= length && count <= (length - offset) / size);
+    };
+    if (header.instructionCount == 0 ||
+        !fits(header.instructions, header.instructionCount, sizeof(Instruction), alignof(Instruction)) ||
+        !fits(header.symbols, header.symbolCount, sizeof(SymbolEntry), alignof(SymbolEntry)) ||
+        !fits(header.lines, header.lineCount, sizeof(uint32_t), alignof(uint32_t)) ||
+        !fits(header.strings, header.stringsLength, 1, 1))
+        return false;
+
+    auto base = file->WritableData();
+    auto strings = base + header.strings;
+    auto isString = [&](uint64_t offset, uint64_t count)
+    {
+        return (offset <= header.stringsLength && count <= header.stringsLength - offset);
+    };
+
+    auto entries = reinterpret_cast<const SymbolEntry*>(base + header.symbols);
+    for (size_t i = 0; i < header.symbolCount; ++i)
+    {
+        if (!isString(entries[i].offset, entries[i].length))
+            return false;
+    }
+
+    //fix up the instructions in place (the mapping is private, so a file that turns out to be invalid is not changed)
+    auto instructions = reinterpret_cast<Instruction*>(base + header.instructions);
+    for (size_t i = 0; i < header.instructionCount; ++i)
+    {
+        auto& instruction = instructions[i];
+        if (instruction.value.index() >= std::variant_size<Instruction::ValueType>::value ||
+            instruction.type > InstructionType::Deferred)
+            return false;
+
+        //every symbol can reach Symbols::Name (e.g. a callee's, when calling a builtin operator)
+        if (instruction.symbol != NoSymbol && instruction.symbol >= header.symbolCount)
+            return false;
+
+        if (auto list = std::get_if<TList>(&instruction.value))
+        {
+            auto start = reinterpret_cast<uintptr_t>(list->begin());
+            if (start <= i || start > header.instructionCount || list->size() > header.instructionCount - start)
+                return false;
+            instruction.value = TList(instructions + start, list->size());
+        }
+        else if (auto string = std::get_if<TString>(&instruction.value))
+        {
+            auto offset = reinterpret_cast<uintptr_t>(string->data());
+            if (!isString(offset, string->length()))
+                return false;
+            instruction.value = TString(strings + offset, string->length());
+        }
+    }
+
+    //the symbols and module are only registered once the whole image is valid
+    std::vector<SymbolId> symbols(header.symbolCount);
+    for (size_t i = 0; i < symbols.size(); ++i)
+        symbols[i] = Symbols::Intern(std::string_view(strings + entries[i].offset, (size_t)entries[i].length));
+
+    auto module = Modules::Register(ModuleName, Source);
+    for (size_t i = 0; i < header.instructionCount; ++i)
+    {
+        auto& instruction = instructions[i];
+        instruction.location.module = (instruction.location.module == 0 ? module : NoModule);
+        if (instruction.symbol != NoSymbol)
+        {
+            instruction.symbol = symbols[instruction.symbol];
+            if (std::holds_alternative<TString>(instruction.value))
+                instruction.value = Symbols::Name(instruction.symbol);
+        }
+    }
+
+    auto lines = reinterpret_cast<const uint32_t*>(base + header.lines);
+    if (header.lineCount > 0)
+        Modules::SetLineStarts(module, std::vector<uint32_t>(lines, lines + header.lineCount));
+
+    Program.root = instructions[0];
+    Program.module = module;
+    Program.owner = std::move(file);
+    return true;
+}
+
+ProgramCache::Program ProgramCache::LoadOrParse(const std::string& SourcePath, std::vector<Report>& Errors, bool Lazy)
+{
+    //the source is kept with the program since its module refers to it
+    struct Storage
+    {
+        MappedFile source;
+        std::shared_ptr<const void> program;
+    };
+
+    auto storage = std::make_shared<Storage>();
+    if (!storage->source.Open(SourcePath))
+        return { };
+
+    auto source = storage->source.View();
+    auto cachePath = PathFor(SourcePath);
+
+    Program program;
+    if (!Load(cachePath, SourcePath, source, program))
+    {
+        //bodies are only deferred when the program is not cached, so that a syntax error in one that has not been called yet is not cached as a clean program
+        Lexer lexer(SourcePath, source);
+        Parser parser;
+        parser.deferBodies = Lazy;
+        if (parser.Parse(lexer))
+        {
+            if (!Lazy)
+                Save(cachePath, source, lexer.Module(), parser.root);
+        }
+        else
+            Errors.insert(Errors.end(), parser.errors.begin(), parser.errors.end());
+
+        program.root = parser.root;
+        program.module = lexer.Module();
+        program.owner = parser.arena;
+    }
+
+    storage->program = std::move(program.owner);
+    program.owner = std::move(storage);
+    return program;
+}
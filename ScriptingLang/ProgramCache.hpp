@@ -0,0 +1,41 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Instruction.hpp"
+#include "ReportLog.hpp"
+
+namespace Plang
+{
+    //Parsed programs stored next to their source (script.plang -> script.plangc) so that unchanged scripts do not need to be parsed again.
+    //A cache file holds the instruction tree, the names of the symbols it uses, and the source's line index.
+    //It is loaded with a single mapping of the file, after which pointers and symbol ids in the tree are fixed up in place.
+    //Cache files are only valid for the build that wrote them and are ignored if the hash of the source does not match
+    class ProgramCache
+    {
+    public:
+        static constexpr uint32_t Version = 2;
+
+        //A loaded or parsed program. The owner keeps the instructions alive
+        struct Program
+        {
+            Instruction root;
+            ModuleId module = NoModule;
+            std::shared_ptr<const void> owner;
+        };
+
+        static inline std::string PathFor(const std::string& SourcePath) { return SourcePath + "c"; }
+        static uint64_t Hash(std::string_view Source);
+
+        //Load the program of a source from a cache file, registering the source as a new module. Fails if the cache is missing, stale, or invalid
+        static bool Load(const std::string& CachePath, const std::string& ModuleName, std::string_view Source, Program& Program);
+
+        //Write a parsed program to a cache file. Returns false if the file could not be written
+        static bool Save(const std::string& CachePath, std::string_view Source, ModuleId Module, const Instruction& Root);
+
+        //Load a source file's program from its cache if it is up to date, otherwise parse it (in full) and update the cache (if there were no errors).
+        //The root is Unknown if the source could not be read.
+        //If Lazy, a missing or stale cache is left as is and expression bodies are deferred (see Parser::deferBodies), so that only the bodies
+        //that are called are parsed. Syntax errors in those are then thrown when they are called, rather than reported here
+        static Program LoadOrParse(const std::string& SourcePath, std::vector<Report>& Errors, bool Lazy = false);
+    };
+};
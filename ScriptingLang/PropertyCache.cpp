@@ -0,0 +1,45 @@
+#include "pch.hpp"
+#include "PropertyCache.hpp"
+
+using namespace Plang;
+
+const Value& PropertyCache::Get(const Construct& Scope, const std::string& Name)
+{
+    auto hit = true;
+    for (auto scope = &Scope; scope != nullptr; scope = scope->prototype.get())
+    {
+        auto shape = scope->shape.get();
+        const Entry* entry = nullptr;
+        for (size_t i = 0; i < Size && shape != nullptr; ++i)
+        {
+            if (entries[i].shape.get() == shape)
+            {
+                entry = &entries[i];
+                break;
+            }
+        }
+
+        auto slot = Shape::NotFound;
+        if (entry != nullptr)
+            slot = entry->slot;
+        else
+        {
+            hit = false;
+            slot = scope->FindSlot(Name);
+            if (shape != nullptr)
+            {
+                entries[next] = { scope->shape, slot };
+                next = (next + 1) % Size;
+            }
+        }
+
+        if (slot != Shape::NotFound)
+        {
+            ++(hit ? hits : misses);
+            return scope->slots[slot];
+        }
+    }
+
+    ++(hit ? hits : misses);
+    return Undefined;
+}
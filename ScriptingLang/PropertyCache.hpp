@@ -0,0 +1,32 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Construct.hpp"
+
+namespace Plang
+{
+    //Caches the property lookups at one site in a script (an identifier or one property of an accessor).
+    //Remembers the slot of the property for the last few shapes searched (or that it is not in constructs of that shape),
+    //so lookups through constructs of those shapes only compare shapes. Constructs in dictionary mode are searched every time.
+    //Not locked, even with PLANG_ATOMIC_REFERENCES (see Reference.hpp)
+    class PropertyCache
+    {
+    public:
+        static constexpr size_t Size = 4; //the number of shapes remembered
+
+        //Get a property of a scope (searching its prototypes), the same as Scope.Get(Name)
+        const Value& Get(const Construct& Scope, const std::string& Name);
+
+        uint64_t hits = 0; //lookups that only compared shapes
+        uint64_t misses = 0;
+
+    protected:
+        struct Entry
+        {
+            Shape::Ref shape; //kept alive so that another shape cannot take its address
+            uint32_t slot = Shape::NotFound;
+        };
+        Entry entries[Size];
+        size_t next = 0; //the entry replaced by the next miss
+    };
+};
@@ -0,0 +1,9 @@
+#include "pch.hpp"
+#include "Reference.hpp"
+
+using namespace Plang;
+
+void Counted::Destroy(Counted* Object)
+{
+    delete Object;
+}
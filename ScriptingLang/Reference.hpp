@@ -0,0 +1,104 @@
+#pragma once
+
+#include "pch.hpp"
+#ifdef PLANG_ATOMIC_REFERENCES
+#include <atomic>
+#endif
+
+namespace Plang
+{
+    //Reference counts are not atomic by default, as the runtime is single-threaded.
+    //Define PLANG_ATOMIC_REFERENCES to use atomic counts, for programs that share constructs between threads.
+    //Constructs, their shapes and the heap can then be used on several threads, but each script must only be run by one thread at a time
+    //(its bytecode and property caches are not locked), and a construct must not be changed while another thread uses it
+#ifdef PLANG_ATOMIC_REFERENCES
+    using ReferenceCount = std::atomic<uint32_t>;
+#else
+    using ReferenceCount = uint32_t;
+#endif
+
+    //The base of objects owned by References. The count is stored in the object, so a reference is a single pointer
+    class Counted
+    {
+    public:
+        Counted() = default;
+        Counted(const Counted&) { } //the count belongs to the object, not its value
+        Counted& operator = (const Counted&) { return *this; }
+        virtual ~Counted() = default;
+
+        inline uint32_t References() const { return references; }
+
+    protected:
+        template <class T>
+        friend class Reference;
+
+        mutable ReferenceCount references { 0 };
+
+        static void Destroy(Counted* Object); //out of line, so that releasing a reference inlines to a decrement
+    };
+
+    //An intrusive reference counted pointer to a Counted object, deleted when the last reference to it is released
+    template <class T>
+    class Reference
+    {
+    public:
+        Reference() = default;
+        Reference(std::nullptr_t) { }
+        explicit Reference(T* Object) : counted(const_cast<std::remove_const_t<T>*>(Object)) { Retain(); } //the count of a const object can still change
+
+        Reference(const Reference& Other) : counted(Other.counted) { Retain(); }
+        Reference(Reference&& Other) noexcept : counted(Other.counted) { Other.counted = nullptr; }
+        template <class U, typename = std::enable_if_t<std::is_convertible<U*, T*>::value>>
+        Reference(const Reference<U>& Other) : counted(Other.counted) { Retain(); }
+        template <class U, typename = std::enable_if_t<std::is_convertible<U*, T*>::value>>
+        Reference(Reference<U>&& Other) noexcept : counted(Other.counted) { Other.counted = nullptr; }
+        ~Reference() { Release(); }
+
+        inline Reference& operator = (const Reference& Other) { Reference(Other).Swap(*this); return *this; }
+        inline Reference& operator = (Reference&& Other) noexcept { Reference(std::move(Other)).Swap(*this); return *this; }
+        inline Reference& operator = (std::nullptr_t) { reset(); return *this; }
+
+        inline T* get() const { return static_cast<T*>(counted); }
+        inline T& operator *() const { return *get(); }
+        inline T* operator ->() const { return get(); }
+        inline explicit operator bool() const { return counted != nullptr; }
+
+        inline void reset() { Release(); counted = nullptr; }
+        inline void Swap(Reference& Other) noexcept { std::swap(counted, Other.counted); }
+
+        template <class U>
+        inline bool operator == (const Reference<U>& Other) const { return counted == Other.counted; }
+        template <class U>
+        inline bool operator != (const Reference<U>& Other) const { return counted != Other.counted; }
+        inline bool operator == (std::nullptr_t) const { return counted == nullptr; }
+        inline bool operator != (std::nullptr_t) const { return counted != nullptr; }
+
+    protected:
+        template <class U>
+        friend class Reference;
+
+        Counted* counted = nullptr;
+
+        inline void Retain() const
+        {
+            if (counted == nullptr)
+                return;
+#ifdef PLANG_ATOMIC_REFERENCES
+            counted->references.fetch_add(1, std::memory_order_relaxed);
+#else
+            ++counted->references;
+#endif
+        }
+        inline void Release() const
+        {
+            if (counted == nullptr)
+                return;
+#ifdef PLANG_ATOMIC_REFERENCES
+            if (counted->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+#else
+            if (--counted->references == 0)
+#endif
+                Counted::Destroy(counted);
+        }
+    };
+};
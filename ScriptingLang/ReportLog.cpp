@@ -3,4 +3,32 @@
 
 using namespace Plang;
 
-size_t ReportLog::nextTypeId = 0x1000;
\ No newline at end of file
+size_t ReportLog::nextTypeId = 0x1000;
+std::map<ReportTypeId, ReportType> ReportLog::types;
+std::map<ReportLevel, std::vector<Report>> ReportLog::reports;
+std::deque<ReportLog::ReportIndex> ReportLog::reportTimeline;
+
+std::string ReportLog::Format(const Report& Report)
+{
+	auto& description = GetType(Report.type).description;
+
+	std::string formatted;
+	for (size_t i = 0; i < description.length(); ++i)
+	{
+		if (description[i] != '$' || i + 1 >= description.length() || !isdigit((unsigned char)description[i + 1]))
+		{
+			formatted += description[i];
+			continue;
+		}
+
+		size_t arg = 0;
+		while (i + 1 < description.length() && isdigit((unsigned char)description[i + 1]))
+			arg = (arg * 10) + (description[++i] - '0');
+
+		if (arg == 0)
+			formatted += std::to_string(Report.arguments.Length());
+		else if (arg <= Report.arguments.Length())
+			formatted += Report.arguments[arg - 1];
+	}
+	return formatted;
+}
@@ -39,7 +39,6 @@ namespace Plang
 		ReportTypeId type;
 
 		Location location;
-		size_t filePos; //file name stored in `location`
 
 		::Array<std::string> arguments; //possibly just inline to two/three args
 	};
@@ -65,6 +64,11 @@ namespace Plang
 			reps.push_back(Report);
 		}
 
+		static inline const std::vector<Report>& Reports(ReportLevel Level) { return reports[Level]; }
+
+		//Format a report using its type's description
+		static std::string Format(const Report& Report);
+
 		//todo: iterators
 
 	protected:
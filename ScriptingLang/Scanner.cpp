@@ -0,0 +1,403 @@
+#include "pch.hpp"
+#include "Scanner.hpp"
+#include "CharClass.hpp"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define PLANG_SCANNER_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define PLANG_TARGET_AVX2
+#else
+#define PLANG_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+using namespace Plang;
+
+namespace
+{
+    //characters that end a literal (besides whitespace), for the vector kernels
+    constexpr char separators[] = "()[]{};,.+-*/%!^&|~=:?<>";
+
+    constexpr bool SeparatorsMatchCharClasses()
+    {
+        size_t count = 0;
+        for (unsigned ch = ' ' + 1; ch < 0x80; ++ch)
+            count += CharClass::Is((unsigned char)ch, CharClass::LiteralEnd);
+        for (size_t i = 0; i < sizeof(separators) - 1; ++i)
+        {
+            if (!CharClass::Is((unsigned char)separators[i], CharClass::LiteralEnd))
+                return false;
+        }
+        return count == sizeof(separators) - 1;
+    }
+    static_assert(SeparatorsMatchCharClasses(), "separators must match CharClass::LiteralEnd");
+
+    //Non-ASCII bytes stop literals so that the lexer can decode them (see Lexer::ReadLiteral)
+    inline bool IsWhitespace(unsigned char ch) { return CharClass::Is(ch, CharClass::Whitespace); }
+    inline bool IsSeparator(unsigned char ch) { return CharClass::Is(ch, CharClass::LiteralEnd | CharClass::NonAscii); }
+
+    inline unsigned FirstBit(uint32_t mask)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return index;
+#else
+        return (unsigned)__builtin_ctz(mask);
+#endif
+    }
+
+    //scalar
+
+    const char* SkipWhitespaceScalar(const char* begin, const char* end)
+    {
+        while (begin < end && IsWhitespace((unsigned char)*begin))
+            ++begin;
+        return begin;
+    }
+    const char* SkipLiteralScalar(const char* begin, const char* end)
+    {
+        while (begin < end && !IsSeparator((unsigned char)*begin))
+            ++begin;
+        return begin;
+    }
+    const char* FindBlockCommentEndScalar(const char* begin, const char* end)
+    {
+        while (begin < end - 1)
+        {
+            auto star = static_cast<const char*>(memchr(begin, '*', (size_t)(end - 1 - begin)));
+            if (star == nullptr)
+                break;
+            if (star[1] == '/')
+                return star;
+            begin = star + 1;
+        }
+        return end;
+    }
+    const char* FindStringEndScalar(const char* begin, const char* end, char quote)
+    {
+        while (begin < end)
+        {
+            if (*begin == quote)
+                return begin;
+            begin += (*begin == '\\' ? 2 : 1);
+        }
+        return end;
+    }
+    const char* FindQuoteOrSlashScalar(const char* begin, const char* end)
+    {
+        while (begin < end && *begin != '\'' && *begin != '"' && *begin != '/')
+            ++begin;
+        return begin;
+    }
+    void IndexLinesScalar(const char* begin, const char* end, uint32_t baseOffset, std::vector<uint32_t>& lineStarts)
+    {
+        auto start = begin;
+        const char* newline;
+        while ((newline = static_cast<const char*>(memchr(begin, '\n', (size_t)(end - begin)))) != nullptr)
+        {
+            lineStarts.push_back(baseOffset + (uint32_t)(newline + 1 - start));
+            begin = newline + 1;
+        }
+    }
+
+    inline void AddLineStarts(uint32_t mask, uint32_t offset, std::vector<uint32_t>& lineStarts)
+    {
+        for (; mask != 0; mask &= mask - 1)
+            lineStarts.push_back(offset + FirstBit(mask) + 1);
+    }
+
+#ifdef PLANG_SCANNER_X86
+
+    //SSE2 (16 bytes at a time)
+
+    inline __m128i Load16(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    inline __m128i Splat16(char ch) { return _mm_set1_epi8(ch); }
+
+    inline __m128i WhitespaceMask16(__m128i chars)
+    {
+        auto space = Splat16(' ');
+        return _mm_cmpeq_epi8(_mm_max_epu8(chars, space), space); //unsigned <= ' '
+    }
+
+    const char* SkipWhitespaceSSE2(const char* begin, const char* end)
+    {
+        for (; end - begin >= 16; begin += 16)
+        {
+            auto mask = (uint32_t)_mm_movemask_epi8(WhitespaceMask16(Load16(begin))) ^ 0xffff;
+            if (mask != 0)
+                return begin + FirstBit(mask);
+        }
+        return SkipWhitespaceScalar(begin, end);
+    }
+    const char* SkipLiteralSSE2(const char* begin, const char* end)
+    {
+        for (; end - begin >= 16; begin += 16)
+        {
+            auto chars = Load16(begin);
+            auto stop = _mm_or_si128(WhitespaceMask16(chars), _mm_cmplt_epi8(chars, _mm_setzero_si128())); //non-ASCII bytes are negative
+            for (size_t i = 0; i < sizeof(separators) - 1; ++i)
+                stop = _mm_or_si128(stop, _mm_cmpeq_epi8(chars, Splat16(separators[i])));
+
+            auto mask = (uint32_t)_mm_movemask_epi8(stop);
+            if (mask != 0)
+                return begin + FirstBit(mask);
+        }
+        return SkipLiteralScalar(begin, end);
+    }
+    const char* FindBlockCommentEndSSE2(const char* begin, const char* end)
+    {
+        for (; end - begin >= 17; begin += 16)
+        {
+            auto stars = _mm_cmpeq_epi8(Load16(begin), Splat16('*'));
+            auto slashes = _mm_cmpeq_epi8(Load16(begin + 1), Splat16('/'));
+            auto mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(stars, slashes));
+            if (mask != 0)
+                return begin + FirstBit(mask);
+        }
+        return FindBlockCommentEndScalar(begin, end);
+    }
+    const char* FindStringEndSSE2(const char* begin, const char* end, char quote)
+    {
+        while (end - begin >= 16)
+        {
+            auto chars = Load16(begin);
+            auto mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chars, Splat16(quote)), _mm_cmpeq_epi8(chars, Splat16('\\'))));
+            if (mask == 0)
+            {
+                begin += 16;
+                continue;
+            }
+
+            begin += FirstBit(mask);
+            if (*begin == quote)
+                return begin;
+            begin += 2; //skip the escaped character
+        }
+        return FindStringEndScalar(begin, end, quote);
+    }
+    const char* FindQuoteOrSlashSSE2(const char* begin, const char* end)
+    {
+        for (; end - begin >= 16; begin += 16)
+        {
+            auto chars = Load16(begin);
+            auto stop = _mm_or_si128(_mm_cmpeq_epi8(chars, Splat16('\'')), _mm_or_si128(_mm_cmpeq_epi8(chars, Splat16('"')), _mm_cmpeq_epi8(chars, Splat16('/'))));
+            auto mask = (uint32_t)_mm_movemask_epi8(stop);
+            if (mask != 0)
+                return begin + FirstBit(mask);
+        }
+        return FindQuoteOrSlashScalar(begin, end);
+    }
+    void IndexLinesSSE2(const char* begin, const char* end, uint32_t baseOffset, std::vector<uint32_t>& lineStarts)
+    {
+        for (; end - begin >= 16; begin += 16, baseOffset += 16)
+            AddLineStarts((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(Load16(begin), Splat16('\n'))), baseOffset, lineStarts);
+        IndexLinesScalar(begin, end, baseOffset, lineStarts);
+    }
+
+    //AVX2 (32 bytes at a time)
+
+    PLANG_TARGET_AVX2 inline __m256i Load32(const char* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    PLANG_TARGET_AVX2 inline __m256i Splat32(char ch) { return _mm256_set1_epi8(ch); }
+
+    PLANG_TARGET_AVX2 inline __m256i WhitespaceMask32(__m256i chars)
+    {
+        auto space = Splat32(' ');
+        return _mm256_cmpeq_epi8(_mm256_max_epu8(chars, space), space);
+    }
+
+    //Nibble lookup tables for classifying separators with two shuffles.
+    //Each distinct high nibble in the separator set gets its own bit, so (lo[c & 15] & hi[c >> 4]) != 0 exactly when c is a separator
+    struct NibbleTables
+    {
+        alignas(32) uint8_t lo[32] = { };
+        alignas(32) uint8_t hi[32] = { };
+
+        NibbleTables()
+        {
+            uint8_t bits[16] = { };
+            uint8_t nextBit = 1;
+
+            auto add = [&](unsigned char ch)
+            {
+                auto& bit = bits[ch >> 4];
+                if (bit == 0)
+                {
+                    bit = nextBit;
+                    nextBit <<= 1;
+                }
+                lo[ch & 15] |= bit;
+                hi[ch >> 4] = bit;
+            };
+
+            for (unsigned ch = 0; ch <= ' '; ++ch)
+                add((unsigned char)ch);
+            for (size_t i = 0; i < sizeof(separators) - 1; ++i)
+                add((unsigned char)separators[i]);
+
+            assert(nextBit != 0); //at most 8 distinct high nibbles
+
+            //shuffles operate per 128 bit lane
+            std::copy(lo, lo + 16, lo + 16);
+            std::copy(hi, hi + 16, hi + 16);
+        }
+    };
+    const NibbleTables nibbleTables;
+
+    PLANG_TARGET_AVX2 const char* SkipWhitespaceAVX2(const char* begin, const char* end)
+    {
+        for (; end - begin >= 32; begin += 32)
+        {
+            auto mask = ~(uint32_t)_mm256_movemask_epi8(WhitespaceMask32(Load32(begin)));
+            if (mask != 0)
+                return begin + FirstBit(mask);
+        }
+        return SkipWhitespaceSSE2(begin, end);
+    }
+    PLANG_TARGET_AVX2 const char* SkipLiteralAVX2(const char* begin, const char* end)
+    {
+        auto lo = _mm256_load_si256(reinterpret_cast<const __m256i*>(nibbleTables.lo));
+        auto hi = _mm256_load_si256(reinterpret_cast<const __m256i*>(nibbleTables.hi));
+        auto nibble = Splat32(0x0f);
+
+        for (; end - begin >= 32; begin += 32)
+        {
+            auto chars = Load32(begin);
+            auto loClass = _mm256_shuffle_epi8(lo, _mm256_and_si256(chars, nibble));
+            auto hiClass = _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(chars, 4), nibble));
+            auto literal = _mm256_cmpeq_epi8(_mm256_and_si256(loClass, hiClass), _mm256_setzero_si256());
+
+            auto mask = ~(uint32_t)_mm256_movemask_epi8(literal) | (uint32_t)_mm256_movemask_epi8(chars); //non-ASCII bytes have the top bit set
+            if (mask != 0)
+                return begin + FirstBit(mask);
+        }
+        return SkipLiteralSSE2(begin, end);
+    }
+    PLANG_TARGET_AVX2 const char* FindBlockCommentEndAVX2(const char* begin, const char* end)
+    {
+        for (; end - begin >= 33; begin += 32)
+        {
+            auto stars = _mm256_cmpeq_epi8(Load32(begin), Splat32('*'));
+            auto slashes = _mm256_cmpeq_epi8(Load32(begin + 1), Splat32('/'));
+            auto mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(stars, slashes));
+            if (mask != 0)
+                return begin + FirstBit(mask);
+        }
+        return FindBlockCommentEndSSE2(begin, end);
+    }
+    PLANG_TARGET_AVX2 const char* FindStringEndAVX2(const char* begin, const char* end, char quote)
+    {
+        while (end - begin >= 32)
+        {
+            auto chars = Load32(begin);
+            auto mask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(chars, Splat32(quote)), _mm256_cmpeq_epi8(chars, Splat32('\\'))));
+            if (mask == 0)
+            {
+                begin += 32;
+                continue;
+            }
+
+            begin += FirstBit(mask);
+            if (*begin == quote)
+                return begin;
+            begin += 2;
+        }
+        return FindStringEndSSE2(begin, end, quote);
+    }
+    PLANG_TARGET_AVX2 const char* FindQuoteOrSlashAVX2(const char* begin, const char* end)
+    {
+        for (; end - begin >= 32; begin += 32)
+        {
+            auto chars = Load32(begin);
+            auto stop = _mm256_or_si256(_mm256_cmpeq_epi8(chars, Splat32('\'')), _mm256_or_si256(_mm256_cmpeq_epi8(chars, Splat32('"')), _mm256_cmpeq_epi8(chars, Splat32('/'))));
+            auto mask = (uint32_t)_mm256_movemask_epi8(stop);
+            if (mask != 0)
+                return begin + FirstBit(mask);
+        }
+        return FindQuoteOrSlashSSE2(begin, end);
+    }
+    PLANG_TARGET_AVX2 void IndexLinesAVX2(const char* begin, const char* end, uint32_t baseOffset, std::vector<uint32_t>& lineStarts)
+    {
+        for (; end - begin >= 32; begin += 32, baseOffset += 32)
+            AddLineStarts((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(Load32(begin), Splat32('\n'))), baseOffset, lineStarts);
+        IndexLinesSSE2(begin, end, baseOffset, lineStarts);
+    }
+
+    bool SupportsAVX2()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6; //OSXSAVE and XMM/YMM state enabled
+        if (!osSavesYmm)
+            return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        __builtin_cpu_init(); //may run before the cpu model is initialized (during static initialization)
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+
+#endif
+
+    struct Kernels
+    {
+        Scanner::InstructionSet set;
+        const char* (*skipWhitespace)(const char*, const char*);
+        const char* (*skipLiteral)(const char*, const char*);
+        const char* (*findBlockCommentEnd)(const char*, const char*);
+        const char* (*findStringEnd)(const char*, const char*, char);
+        const char* (*findQuoteOrSlash)(const char*, const char*);
+        void (*indexLines)(const char*, const char*, uint32_t, std::vector<uint32_t>&);
+    };
+
+    Kernels SelectKernels(Scanner::InstructionSet set)
+    {
+#ifdef PLANG_SCANNER_X86
+        if (set == Scanner::InstructionSet::AVX2 && SupportsAVX2())
+            return { Scanner::InstructionSet::AVX2, SkipWhitespaceAVX2, SkipLiteralAVX2, FindBlockCommentEndAVX2, FindStringEndAVX2, FindQuoteOrSlashAVX2, IndexLinesAVX2 };
+        if (set != Scanner::InstructionSet::Scalar)
+            return { Scanner::InstructionSet::SSE2, SkipWhitespaceSSE2, SkipLiteralSSE2, FindBlockCommentEndSSE2, FindStringEndSSE2, FindQuoteOrSlashSSE2, IndexLinesSSE2 };
+#endif
+        return { Scanner::InstructionSet::Scalar, SkipWhitespaceScalar, SkipLiteralScalar, FindBlockCommentEndScalar, FindStringEndScalar, FindQuoteOrSlashScalar, IndexLinesScalar };
+    }
+
+    Kernels kernels = SelectKernels(Scanner::InstructionSet::AVX2);
+}
+
+Scanner::InstructionSet Scanner::ActiveInstructionSet()
+{
+    return kernels.set;
+}
+void Scanner::SetInstructionSet(InstructionSet set)
+{
+    kernels = SelectKernels(set);
+}
+
+const char* Scanner::SkipWhitespace(const char* begin, const char* end)
+{
+    return kernels.skipWhitespace(begin, end);
+}
+const char* Scanner::SkipLiteral(const char* begin, const char* end)
+{
+    return kernels.skipLiteral(begin, end);
+}
+const char* Scanner::FindBlockCommentEnd(const char* begin, const char* end)
+{
+    return kernels.findBlockCommentEnd(begin, end);
+}
+const char* Scanner::FindStringEnd(const char* begin, const char* end, char quote)
+{
+    return kernels.findStringEnd(begin, end, quote);
+}
+const char* Scanner::FindQuoteOrSlash(const char* begin, const char* end)
+{
+    return kernels.findQuoteOrSlash(begin, end);
+}
+void Scanner::IndexLines(const char* begin, const char* end, uint32_t baseOffset, std::vector<uint32_t>& lineStarts)
+{
+    kernels.indexLines(begin, end, baseOffset, lineStarts);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "pch.hpp"
+
+//Bulk scanning kernels used by the lexer. Each kernel takes a [begin, end) range and returns the first position that stops the scan (or end)
+//SSE2 and AVX2 versions are selected at runtime, with a scalar fallback on other architectures
+namespace Plang
+{
+    namespace Scanner
+    {
+        enum class InstructionSet
+        {
+            Scalar,
+            SSE2,
+            AVX2,
+        };
+
+        InstructionSet ActiveInstructionSet();
+        void SetInstructionSet(InstructionSet set); //override the detected instruction set (falls back to the best supported set)
+
+        const char* SkipWhitespace(const char* begin, const char* end); //ASCII whitespace: bytes <= ' '
+        const char* SkipLiteral(const char* begin, const char* end); //see Lexer::CharIsLiteral. Also stops at non-ASCII bytes
+        const char* FindBlockCommentEnd(const char* begin, const char* end); //returns the position of the closing */
+        const char* FindStringEnd(const char* begin, const char* end, char quote); //returns the position of the first unescaped quote
+        const char* FindQuoteOrSlash(const char* begin, const char* end); //returns the position of the first ' " or / (possible string or comment starts)
+
+        //append the offset of the start of each line after a newline in a range. baseOffset is the offset of begin
+        void IndexLines(const char* begin, const char* end, uint32_t baseOffset, std::vector<uint32_t>& lineStarts);
+    };
+};
@@ -0,0 +1,136 @@
+#include "pch.hpp"
+#include "Shape.hpp"
+#ifdef PLANG_ATOMIC_REFERENCES
+#include <mutex>
+#endif
+
+using namespace Plang;
+
+namespace
+{
+#ifdef PLANG_ATOMIC_REFERENCES
+    //guards the transitions of every shape. Never destroyed, as shapes may be released during exit
+    std::mutex& Mutex()
+    {
+        static auto mutex = new std::mutex;
+        return *mutex;
+    }
+#define LOCK_SHAPES() std::lock_guard<std::mutex> lock(Mutex())
+#else
+#define LOCK_SHAPES()
+#endif
+}
+
+const Shape::Ref& Shape::Empty()
+{
+    static const Ref empty(new Shape);
+    return empty;
+}
+
+Shape::~Shape()
+{
+    if (parent == nullptr)
+        return;
+
+    LOCK_SHAPES();
+    auto transition = parent->transitions.find(name);
+    if (transition != parent->transitions.end() && transition->second == this) //(it may already have been replaced, see Add)
+        parent->transitions.erase(transition);
+}
+
+Shape::Ref Shape::Add(const std::string& Name) const
+{
+    LOCK_SHAPES();
+    auto& transition = transitions[Name];
+#ifdef PLANG_ATOMIC_REFERENCES
+    //a shape released on another thread is replaced (its destructor is waiting for the lock to remove it)
+    if (transition != nullptr)
+    {
+        auto references = transition->references.load(std::memory_order_relaxed);
+        while (references != 0 && !transition->references.compare_exchange_weak(references, references + 1, std::memory_order_relaxed)) { }
+        if (references != 0)
+        {
+            Ref existing(transition);
+            transition->references.fetch_sub(1, std::memory_order_relaxed);
+            return existing;
+        }
+    }
+#else
+    if (transition != nullptr)
+        return Ref(transition);
+#endif
+
+    auto shape = new Shape;
+    shape->parent = Ref(this);
+    shape->name = Name;
+    shape->count = count + 1;
+#ifdef PLANG_ATOMIC_REFERENCES
+    if (shape->count > MaxLinearSearch)
+        shape->BuildIndex(); //so that lookups do not change the shape
+#endif
+    transition = shape;
+    return Ref(shape);
+}
+Shape::Ref Shape::Remove(size_t Slot) const
+{
+    assert(Slot < count);
+
+    //go back to the shape before the property was added and add the ones after it again
+    std::vector<const Shape*> later;
+    auto shape = this;
+    for (; shape->count > Slot + 1; shape = shape->parent.get())
+        later.push_back(shape);
+
+    auto removed = shape->parent;
+    for (auto next = later.rbegin(); next != later.rend(); ++next)
+        removed = removed->Add((*next)->name);
+    return removed;
+}
+
+uint32_t Shape::Find(std::string_view Name) const
+{
+    if (count <= MaxLinearSearch)
+    {
+        for (auto shape = this; shape->count > 0; shape = shape->parent.get())
+        {
+            if (shape->name == Name)
+                return (uint32_t)shape->count - 1;
+        }
+        return NotFound;
+    }
+
+    BuildIndex();
+    auto slot = slots.find(Name);
+    return (slot != slots.end() ? slot->second : NotFound);
+}
+
+const std::string& Shape::Name(size_t Slot) const
+{
+    assert(Slot < count);
+
+    if (count <= MaxLinearSearch)
+    {
+        auto shape = this;
+        while (shape->count > Slot + 1)
+            shape = shape->parent.get();
+        return shape->name;
+    }
+
+    BuildIndex();
+    return *names[Slot];
+}
+
+void Shape::BuildIndex() const
+{
+    if (!names.empty())
+        return;
+
+    //the names are owned by this shape and its parents, which live as long as this
+    names.resize(count);
+    slots.reserve(count);
+    for (auto shape = this; shape->count > 0; shape = shape->parent.get())
+    {
+        names[shape->count - 1] = &shape->name;
+        slots[shape->name] = (uint32_t)shape->count - 1;
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Reference.hpp"
+
+namespace Plang
+{
+    //The layout of a construct's properties (hidden class): which slot holds each property name.
+    //Shapes are immutable and shared by every construct that added the same properties in the same order.
+    //Adding or removing a property moves a construct to another shape through the transition tree starting at Empty().
+    //With PLANG_ATOMIC_REFERENCES, shapes may be shared between threads: transitions are locked and indices are built when a shape is created
+    class Shape : public Counted
+    {
+    public:
+        using Ref = Reference<const Shape>;
+
+        static constexpr uint32_t NotFound = ~(uint32_t)0;
+        static constexpr size_t MaxCount = 64; //constructs with more properties use dictionary mode
+
+        Shape() = default;
+        Shape(const Shape&) = delete;
+        Shape& operator = (const Shape&) = delete;
+        ~Shape() override;
+
+        static const Ref& Empty(); //the shape of a construct without properties
+
+        Ref Add(const std::string& Name) const; //the shape with a property added (in the next slot)
+        Ref Remove(size_t Slot) const; //the shape with a property removed (later properties move down a slot)
+
+        uint32_t Find(std::string_view Name) const; //the slot of a property, or NotFound
+        const std::string& Name(size_t Slot) const;
+        inline size_t Count() const { return count; }
+
+    protected:
+        Ref parent; //the shape before the last property was added (null for the empty shape)
+        std::string name; //the last property added, in slot count - 1
+        size_t count = 0;
+
+        mutable std::unordered_map<std::string, const Shape*> transitions; //the shapes with one more property. Each removes itself when destroyed
+
+        //built when first needed by larger shapes, instead of searching through the parents
+        static constexpr size_t MaxLinearSearch = 8;
+        mutable std::vector<const std::string*> names; //by slot
+        mutable std::unordered_map<std::string_view, uint32_t> slots;
+        void BuildIndex() const;
+    };
+};
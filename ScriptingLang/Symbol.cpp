@@ -0,0 +1,19 @@
+#include "pch.hpp"
+#include "Symbol.hpp"
+
+using namespace Plang;
+
+std::deque<std::string> Symbols::names;
+std::unordered_map<std::string_view, SymbolId> Symbols::ids;
+
+SymbolId Symbols::Intern(std::string_view Name)
+{
+    auto found = ids.find(Name);
+    if (found != ids.end())
+        return found->second;
+
+    names.emplace_back(Name);
+    auto id = (SymbolId)(names.size() - 1);
+    ids.emplace(names.back(), id);
+    return id;
+}
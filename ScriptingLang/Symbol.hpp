@@ -0,0 +1,23 @@
+#pragma once
+
+#include "pch.hpp"
+
+namespace Plang
+{
+    using SymbolId = uint32_t;
+    constexpr SymbolId NoSymbol = ~(SymbolId)0;
+
+    //Interned names. Each distinct name is stored once and identified by a small dense id that can be used to index tables.
+    //Interning is not locked, so names must not be interned on several threads at once (see Lexer::ReadAllParallel)
+    class Symbols
+    {
+    public:
+        static SymbolId Intern(std::string_view Name); //get the id of a name, adding it if it is new
+        static inline std::string_view Name(SymbolId Id) { return names[Id]; } //the name of a symbol. Valid for the life of the program
+        static inline size_t Count() { return names.size(); }
+
+    protected:
+        static std::deque<std::string> names; //a deque so that names do not move as symbols are added
+        static std::unordered_map<std::string_view, SymbolId> ids;
+    };
+};
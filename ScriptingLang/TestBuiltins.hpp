@@ -0,0 +1,60 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Lexer.hpp"
+#include "Parser.hpp"
+#include "Construct.hpp"
+#include "Builtins.hpp"
+
+#include <CppUnitTest.h>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Plang
+{
+	namespace Tests
+	{
+		TEST_CLASS(BUILTINS)
+		{
+		public:
+			//the result of a script (or the error it threw), with both evaluators
+			static std::string Evaluate(const std::string& Source, Plang::Script::EvaluationMode Mode)
+			{
+				Plang::Lexer lex ("", Source);
+				Plang::Parser parser;
+				if (!parser.Parse(lex))
+					return "parse error";
+
+				Plang::Script::evaluationMode = Mode;
+				try
+				{
+					auto result = Plang::Script(parser.root, parser.arena).Evaluate(Plang::Heap::New<Plang::Construct>());
+					return result.IsUndefined() ? "undefined" : result.ToString();
+				}
+				catch (const std::string& error) { return error; }
+				catch (const char* error) { return error; }
+			}
+
+			TEST_METHOD(Apply)
+			{
+				Assert::IsTrue(Builtins::Apply("+", (TInt)1, (TInt)2) == Builtins::Operand((TInt)3));
+				Assert::IsTrue(Builtins::Apply("-", (TInt)5, nullptr) == Builtins::Operand((TInt)-5), L"Prefix operators have no right operand");
+				Assert::IsTrue(Builtins::Apply("+", std::string("a"), std::string("b")) == Builtins::Operand(std::string("ab")));
+				Assert::IsTrue(Builtins::Apply("/", (TInt)1, (TInt)0) == Builtins::Operand(nullptr), L"Dividing by zero is not built in");
+				Assert::IsTrue(Builtins::Apply("-", std::string("a"), nullptr) == Builtins::Operand(nullptr));
+			}
+
+			TEST_METHOD(UndefinedOperands)
+			{
+				for (auto mode : { Plang::Script::EvaluationMode::Tree, Plang::Script::EvaluationMode::Bytecode })
+				{
+					Assert::IsTrue(Evaluate("-3;", mode) == "-3");
+					Assert::IsTrue(Evaluate("3 - nope;", mode) == "Undefined (-) is not a function", L"An undefined operand is not a missing one");
+					Assert::IsTrue(Evaluate("3 + nope;", mode) == "Undefined (+) is not a function");
+					Assert::IsTrue(Evaluate("nope * 3;", mode) == "Undefined (*) is not a function");
+					Assert::IsTrue(Evaluate("-nope;", mode) == "Undefined (-) is not a function");
+				}
+				Plang::Script::evaluationMode = Plang::Script::EvaluationMode::Bytecode;
+			}
+		};
+	};
+};
@@ -0,0 +1,177 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Lexer.hpp"
+#include "Parser.hpp"
+#include "Optimizer.hpp"
+#include "Bytecode.hpp"
+
+#include <CppUnitTest.h>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Plang
+{
+	namespace Tests
+	{
+		TEST_CLASS(BYTECODE)
+		{
+		public:
+			static AnyRef MakeScope()
+			{
+				auto scope = Heap::New<Plang::Construct>();
+				auto a = Heap::New<Plang::Construct>();
+				auto c = Heap::New<Plang::Construct>();
+				c->Set("d", Heap::New<Plang::String>("deep"));
+				a->Set("b", 10);
+				a->Set("c", c);
+				scope->Set("a", a);
+				scope->Set("f", Heap::New<Plang::Function>([](Plang::Construct&) { return Value(7); }));
+				scope->Set("x", 2.5);
+				return scope;
+			}
+
+			static std::string Show(const Value& Value)
+			{
+				if (Value.IsUndefined())
+					return "undefined";
+				if (Value.Type() == ConstructType::Script)
+					return "script";
+				if (Value.Type() != ConstructType::List)
+					return Value.ToString();
+
+				std::string out = "[";
+				for (auto& item : Value.As<Plang::List>().value)
+					out += Show(item) + ",";
+				return out + "]";
+			}
+
+			//the results (or errors) of evaluating a script twice, as the second evaluation uses the compiled code
+			static std::string Run(const std::string& Source, Plang::Script::EvaluationMode Mode, bool Optimize, std::shared_ptr<Plang::Script>* Compiled = nullptr)
+			{
+				Plang::Lexer lex ("", Source);
+				Plang::Parser parser;
+				parser.deferBodies = true;
+				if (!parser.Parse(lex))
+					return "parse error";
+
+				auto scope = MakeScope();
+				Plang::Optimizer optimizer (*scope);
+				if (Optimize)
+					optimizer.Optimize(parser.root);
+
+				Plang::Script::evaluationMode = Mode;
+				auto script = std::make_shared<Plang::Script>(parser.root, parser.arena);
+				std::string out;
+				for (int i = 0; i < 2; ++i)
+				{
+					try { out += Show(script->Evaluate(scope)) + " | "; }
+					catch (const std::string& error) { out += error + " | "; }
+					catch (const char* error) { out += std::string(error) + " | "; }
+				}
+				Plang::Script::evaluationMode = Plang::Script::EvaluationMode::Bytecode;
+				if (Compiled != nullptr)
+					*Compiled = script;
+				return out;
+			}
+
+			//the tree walker is the reference for the bytecode, with and without the optimizer
+			TEST_METHOD(Differential)
+			{
+				const char* programs[] =
+				{
+					"1 + 2 * 3;",
+					"7 / 2; 7.0 / 2 + 7 % 3 - -7 % 3 * 2.5;",
+					"'a' + 'b' < 'b'; 'a' == 'a';",
+					"1 && 0 || 2; !0 + !2.5 + ~5;",
+					"1 << 70;",
+					"1 / 0;",
+					"[1, [2.5, 'c'], a.b, x, []];",
+					"a.c.d + 's'; a.b + a.c.d;",
+					"a.q.r;",
+					"f() + f(1, 2) * x;",
+					"y + 1;",
+					"3 - nope;",
+					"-nope;",
+					"((q, w) { q * w; })(6, 7);",
+					"((q) { ((r) { q + r; })(2); })(1);",
+					"((q) { q + ; })(1);",
+					"[(q) { q; }, { 1; 2; }];",
+					"x * 2 == 5.0; 2 * 3 + a.b;",
+					"a; f; x;",
+					"{ a.b; [a.c.d, 'e'] + 1; };",
+					"((q) { 1; 2; })(0);",
+				};
+				for (auto program : programs)
+				{
+					for (auto optimize : { false, true })
+					{
+						auto tree = Run(program, Plang::Script::EvaluationMode::Tree, optimize);
+						auto bytecode = Run(program, Plang::Script::EvaluationMode::Bytecode, optimize);
+						Assert::IsTrue(tree == bytecode, L"Tree and bytecode results differ");
+						Assert::IsTrue(tree == Run(program, Plang::Script::EvaluationMode::Tree, !optimize), L"Optimizing changed a result");
+					}
+				}
+				Assert::IsTrue(Run("1;\n 2; 3;", Plang::Script::EvaluationMode::Bytecode, false) == "Script left 3 values @ (#!):1,1 | Script left 3 values @ (#!):1,1 | ");
+			}
+
+			TEST_METHOD(Superinstructions)
+			{
+				const char* program = "[a.c.d, x + 1, f(), a.b, x];";
+				std::shared_ptr<Plang::Script> fused, unfused;
+				auto expected = Run(program, Plang::Script::EvaluationMode::Bytecode, false, &fused);
+				Bytecode::superinstructions = false;
+				Assert::IsTrue(Run(program, Plang::Script::EvaluationMode::Bytecode, false, &unfused) == expected);
+				Bytecode::superinstructions = true;
+
+				auto count = [](const Bytecode& Code, Opcode Opcode)
+				{
+					return std::count_if(Code.operations.begin(), Code.operations.end(), [&](const Operation& operation) { return operation.opcode == Opcode; });
+				};
+				Assert::IsTrue(count(*fused->code, Opcode::LoadPath) > 0 && count(*fused->code, Opcode::CallConstant) > 0);
+				Assert::IsTrue(count(*unfused->code, Opcode::LoadPath) == 0 && count(*unfused->code, Opcode::CallConstant) == 0);
+				Assert::AreEqual(fused->code->operations.size(), unfused->code->operations.size(), L"Fused operations are skipped, not removed");
+			}
+
+			TEST_METHOD(PropertyCaches)
+			{
+				Plang::Lexer lex ("", "a.b + a.c.e;");
+				Plang::Parser parser;
+				Assert::IsTrue(parser.Parse(lex));
+				Plang::Script script (parser.root, parser.arena);
+
+				auto scope = MakeScope();
+				auto c = scope->Get("a").As<Plang::Construct>().Get("c");
+				c.As<Plang::Construct>().Set("e", 1);
+				for (int i = 0; i < 10; ++i)
+					Assert::AreEqual(script.Evaluate(scope).AsInt(), (TInt)11);
+				auto stats = script.code->CacheStats();
+				Assert::IsTrue(stats.hits > stats.misses);
+
+				//lookups see properties added and changed after they were cached
+				c.As<Plang::Construct>().Set("e", 2);
+				Assert::AreEqual(script.Evaluate(scope).AsInt(), (TInt)12);
+				scope->Get("a").As<Plang::Construct>().Remove("b");
+				scope->Get("a").As<Plang::Construct>().Set("b", 20);
+				Assert::AreEqual(script.Evaluate(scope).AsInt(), (TInt)22);
+
+				auto child = Heap::New<Plang::Construct>(scope);
+				auto a = Heap::New<Plang::Construct>();
+				a->Set("b", 100);
+				a->Set("c", c);
+				child->Set("a", a);
+				Assert::AreEqual(script.Evaluate(child).AsInt(), (TInt)102, L"Names in a child scope shadow the cached ones");
+			}
+
+			TEST_METHOD(ConstantPool)
+			{
+				std::shared_ptr<Plang::Script> script;
+				auto result = Run("[1, 2.5, 'a', 1, 'a', 2.5, 0.0, -0.0];", Plang::Script::EvaluationMode::Bytecode, false, &script);
+				Assert::IsTrue(result == Run("[1, 2.5, 'a', 1, 'a', 2.5, 0.0, -0.0];", Plang::Script::EvaluationMode::Tree, false));
+				Assert::AreEqual(script->code->constants.size(), (size_t)4, L"Each literal is pooled once");
+
+				auto first = script->Evaluate(MakeScope()), second = script->Evaluate(MakeScope());
+				Assert::IsTrue(first.As<Plang::List>()[2] == second.As<Plang::List>()[2], L"String literals are shared by every evaluation");
+			}
+		};
+	};
+};
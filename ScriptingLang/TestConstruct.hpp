@@ -0,0 +1,245 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Lexer.hpp"
+#include "Parser.hpp"
+#include "Construct.hpp"
+
+#include <CppUnitTest.h>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Plang
+{
+	namespace Tests
+	{
+		TEST_CLASS(CONSTRUCT)
+		{
+		public:
+			TEST_METHOD(SharedPrototypes)
+			{
+				auto a = Heap::New<Plang::Int>((TInt)1);
+				auto b = Heap::New<Plang::Int>((TInt)2);
+				Assert::IsTrue(a->prototype == b->prototype, L"Ints share one prototype");
+				Assert::IsTrue(a->Has("!"));
+
+				a->Set("x", 3);
+				a->Set("y", 4, true);
+				a->Set("!", 5, true);
+				Assert::IsTrue(a->Get("x").AsInt() == 3);
+				Assert::IsTrue(!b->Has("x") && !b->Has("y"), L"Missing properties are added to the receiver, not the prototype");
+				Assert::IsTrue(!Plang::Int::Prototype()->Has("y"));
+				Assert::IsTrue(b->Get("!").Type() == ConstructType::Function, L"Inherited properties are shadowed, not overwritten");
+				Assert::IsTrue(Plang::Value(7).Get("!").Type() == ConstructType::Function);
+			}
+
+			TEST_METHOD(SetInParents)
+			{
+				auto parent = Heap::New<Plang::Construct>();
+				parent->Set("a", 1);
+				auto child = Heap::New<Plang::Construct>(parent);
+
+				child->Set("a", 2, true);
+				child->Set("b", 3, true);
+				Assert::IsTrue(parent->Get("a").AsInt() == 2, L"Set where it is defined");
+				Assert::IsTrue(!child->Has("a", false));
+				Assert::IsTrue(child->Has("b", false) && !parent->Has("b"), L"Or in this scope if not found");
+
+				child->Set("a", 4);
+				Assert::IsTrue(child->Get("a").AsInt() == 4 && parent->Get("a").AsInt() == 2);
+			}
+
+			TEST_METHOD(FrozenConstants)
+			{
+				Plang::Lexer lex ("", "'abc';");
+				Plang::Parser parser;
+				Assert::IsTrue(parser.Parse(lex));
+				Plang::Script script (parser.root, parser.arena);
+				Plang::Script::evaluationMode = Plang::Script::EvaluationMode::Bytecode;
+
+				auto literal = script.Evaluate();
+				Assert::IsTrue(literal.As<Plang::Construct>().IsFrozen(), L"String literals are pooled");
+				bool threw = false;
+				try { literal.As<Plang::Construct>().Set("x", 1); }
+				catch (const std::string&) { threw = true; }
+				Assert::IsTrue(threw, L"Thrown like other runtime errors, so that main reports it");
+
+				auto& copy = literal.Modify<Plang::String>();
+				copy.value += "d";
+				copy.Set("x", 1);
+				Assert::IsTrue(!copy.IsFrozen());
+				auto again = script.Evaluate();
+				Assert::IsTrue(again.As<Plang::String>().value == "abc" && !again.As<Plang::Construct>().Has("x"), L"Modifying a copy leaves the literal");
+				Assert::IsTrue(&literal.Modify<Plang::String>() == &copy, L"Copies are not frozen");
+
+				//a native function that changes its argument, given a literal
+				Plang::Lexer callLex ("", "touch('abc');");
+				Plang::Parser callParser;
+				Assert::IsTrue(callParser.Parse(callLex));
+				auto scope = Heap::New<Plang::Construct>();
+				scope->Set("touch", Heap::New<Plang::Function>(Plang::Signature({ { "s" } }), [](const Plang::Construct& scope)
+				{
+					scope.Get("s").As<Plang::Construct>().Set("x", 1);
+					return Value();
+				}));
+				std::string error;
+				try { Plang::Script(callParser.root, callParser.arena).Evaluate(scope); }
+				catch (const std::string& x) { error = x; }
+				Assert::IsTrue(error == "Constants cannot be modified");
+			}
+
+			TEST_METHOD(Shapes)
+			{
+				auto ab = Shape::Empty()->Add("a")->Add("b");
+				Assert::IsTrue(ab == Shape::Empty()->Add("a")->Add("b"), L"Shapes are shared through their transitions");
+				Assert::IsTrue(ab != Shape::Empty()->Add("b")->Add("a"), L"The order of properties matters");
+				Assert::AreEqual(ab->Count(), (size_t)2);
+				Assert::AreEqual(ab->Find("b"), (uint32_t)1);
+				Assert::AreEqual(ab->Find("c"), Shape::NotFound);
+				Assert::IsTrue(ab->Name(0) == "a");
+
+				auto b = ab->Remove(0);
+				Assert::IsTrue(b->Count() == 1 && b->Find("b") == 0 && b->Find("a") == Shape::NotFound);
+
+				//larger shapes are indexed
+				std::vector<std::string> names;
+				Shape::Ref large = Shape::Empty();
+				for (int i = 0; i < 20; ++i)
+				{
+					names.push_back("p" + std::to_string(i));
+					large = large->Add(names.back());
+				}
+				for (size_t i = 0; i < names.size(); ++i)
+					Assert::IsTrue(large->Find(names[i]) == i && large->Name(i) == names[i]);
+				Assert::AreEqual(large->Find("p20"), Shape::NotFound);
+
+				auto removed = large->Remove(5);
+				Assert::IsTrue(removed->Count() == 19 && removed->Find("p5") == Shape::NotFound && removed->Find("p6") == 5);
+
+				//unused shapes are freed, and can be created again
+				auto references = Shape::Empty()->References();
+				large = nullptr;
+				removed = nullptr;
+				Assert::AreEqual(Shape::Empty()->Add("p0")->Add("p1")->Find("p1"), (uint32_t)1);
+				Assert::IsTrue(Shape::Empty()->References() <= references);
+			}
+
+			TEST_METHOD(DictionaryMode)
+			{
+				//more properties than a shape holds
+				auto construct = Heap::New<Plang::Construct>();
+				for (int i = 0; i < (int)Shape::MaxCount * 2; ++i)
+					construct->Set("p" + std::to_string(i), i);
+				Assert::AreEqual(construct->Count(), Shape::MaxCount * 2);
+				Assert::IsTrue(construct->Remove("p3") && !construct->Has("p3") && !construct->Remove("p3"));
+				construct->Set("p3", -3);
+
+				int expected = 0;
+				for (auto property : *construct)
+				{
+					if (expected == 3)
+						++expected;
+					auto slot = expected < (int)Shape::MaxCount * 2 ? expected++ : 3;
+					Assert::IsTrue(property.first == "p" + std::to_string(slot), L"Properties are in the order they were added");
+					Assert::AreEqual(property.second.AsInt(), (TInt)(slot == 3 ? -3 : slot));
+				}
+
+				//many removals
+				auto removing = Heap::New<Plang::Construct>();
+				for (int i = 0; i < 10; ++i)
+					removing->Set("p" + std::to_string(i), i);
+				for (int i = 0; i < 10; i += 2)
+					removing->Remove("p" + std::to_string(i));
+				removing->Set("p0", 10);
+
+				std::string order;
+				for (auto property : *removing)
+					order += property.first + "=" + std::to_string(property.second.AsInt()) + " ";
+				Assert::IsTrue(order == "p1=1 p3=3 p5=5 p7=7 p9=9 p0=10 ");
+
+				auto copy = Heap::New<Plang::Construct>(*removing);
+				Assert::IsTrue(copy->Get("p9").AsInt() == 9 && copy->Count() == 6 && !copy->Has("p2"), L"Copies keep their dictionary");
+			}
+
+			TEST_METHOD(Values)
+			{
+				Assert::IsTrue(Value(5).IsInt() && Value(2.5).IsFloat() && Value().IsUndefined() && Value(nullptr).IsUndefined());
+				Assert::IsTrue(Value(5) == Value(5) && Value(5) != Value(5.0) && Value(2.5) == Value(2.5));
+				Assert::IsTrue(&Value(5).Properties() == Plang::Int::Prototype().get(), L"Numbers are not boxed to find their properties");
+				Assert::IsTrue(&Value(2.5).Properties() == Plang::Float::Prototype().get());
+				Assert::IsTrue(Value(5).Box()->Type() == ConstructType::Int && static_cast<Plang::Int&>(*Value(5).Box()).value == 5);
+
+				auto string = Heap::New<Plang::String>("s");
+				{
+					Value value (string);
+					Assert::IsTrue(value.IsReference() && value.Type() == ConstructType::String);
+					Value copy (value);
+					Assert::AreEqual(string->References(), (uint32_t)3);
+					Value moved (std::move(copy));
+					Assert::IsTrue(copy.IsUndefined() && moved == value);
+					Assert::AreEqual(string->References(), (uint32_t)3);
+
+					moved = 1;
+					Assert::AreEqual(string->References(), (uint32_t)2);
+					value = value;
+					Assert::IsTrue(value.IsReference() && string->References() == 2);
+				}
+				Assert::AreEqual(string->References(), (uint32_t)1);
+			}
+
+			TEST_METHOD(Cycles)
+			{
+				auto threshold = Heap::threshold;
+				Heap::threshold = 0;
+				Heap::Collect();
+				auto live = Heap::Stats().live;
+				{
+					auto a = Heap::New<Plang::Construct>();
+					auto b = Heap::New<Plang::List>();
+					a->Set("b", b);
+					b->Add(a);
+					b->Add(b);
+				}
+				Assert::AreEqual(Heap::Stats().live, live + 2, L"Cycles are not freed by reference counting");
+
+				auto root = Heap::New<Plang::Construct>();
+				{
+					auto c = Heap::New<Plang::Construct>(root);
+					c->Set("self", c);
+					root->Set("c", c);
+				}
+				Assert::AreEqual(Heap::Collect(), (size_t)2);
+				Assert::AreEqual(Heap::Stats().live, live + 2, L"Reachable cycles are kept");
+				Assert::IsTrue(root->Get("c").As<Plang::Construct>().Get("self").As<Plang::Construct>().prototype == root);
+
+				root = nullptr;
+				Assert::AreEqual(Heap::Collect(), (size_t)2);
+				Assert::AreEqual(Heap::Stats().live, live);
+				Heap::threshold = threshold;
+			}
+
+			TEST_METHOD(References)
+			{
+				auto construct = Heap::New<Plang::Construct>();
+				Assert::AreEqual(construct->References(), (uint32_t)1);
+				{
+					AnyRef copy (construct);
+					Assert::AreEqual(construct->References(), (uint32_t)2);
+					AnyRef moved (std::move(copy));
+					Assert::IsTrue(copy == nullptr && moved == construct);
+					Assert::AreEqual(construct->References(), (uint32_t)2);
+					moved.reset();
+					Assert::AreEqual(construct->References(), (uint32_t)1);
+					copy = construct;
+					copy = copy;
+					Assert::AreEqual(construct->References(), (uint32_t)2);
+				}
+				Assert::AreEqual(construct->References(), (uint32_t)1);
+
+				Plang::Construct value (*construct);
+				Assert::AreEqual(value.References(), (uint32_t)0, L"Copying an object does not copy its count");
+				value = *construct;
+				Assert::AreEqual(value.References(), (uint32_t)0);
+			}
+		};
+	};
+};
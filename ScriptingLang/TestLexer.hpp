@@ -17,7 +17,155 @@ namespace Plang
 			{
 				std::istringstream iss ("");
 				Plang::Lexer lex ("", iss);
-				Assert::AreEqual(lex.tokens.size(), 0ull, L"Empty input = Empty output");
+				Assert::AreEqual(lex.ReadAll().size(), 0ull, L"Empty input = Empty output");
+			}
+
+			TEST_METHOD(Buffer)
+			{
+				std::string_view source ("a = 'b'; // c");
+				auto tokens = Plang::Lexer("", source).ReadAll();
+				Assert::AreEqual(tokens.size(), 5ull);
+				Assert::IsTrue(tokens[2].Text() == "'b'");
+				Assert::IsTrue(tokens[2].Text().data() == source.data() + 4, L"Tokens reference the source");
+				Assert::IsTrue(tokens[4].Text() == "// c");
+			}
+
+			TEST_METHOD(EscapedQuotes)
+			{
+				auto tokens = Plang::Lexer("", R"('a\\' "b\"c" /*/ d */)").ReadAll();
+				Assert::AreEqual(tokens.size(), 3ull);
+				Assert::IsTrue(tokens[0].Text() == R"('a\\')");
+				Assert::IsTrue(tokens[1].Text() == R"("b\"c")");
+				Assert::IsTrue(tokens[2].type == LexerTokenType::Comment);
+			}
+
+			TEST_METHOD(Unicode)
+			{
+				std::string source ("v\xE3\x81\x82r = \xE0\xA4\xA0\xE4\xB8\x8D;\xC2\xA0x");
+				Plang::Lexer lex ("", source);
+				auto tokens = lex.ReadAll();
+
+				Assert::AreEqual(tokens.size(), (size_t)5);
+				Assert::IsTrue(tokens[0].Text() == "v\xE3\x81\x82r");
+				Assert::IsTrue(tokens[2].Text() == "\xE0\xA4\xA0\xE4\xB8\x8D"); //U+0920 ends with an A0 byte
+				Assert::IsTrue(tokens[3].type == Plang::LexerTokenType::Terminator);
+				Assert::IsTrue(tokens[4].Text() == "x"); //U+00A0 is whitespace
+			}
+
+			TEST_METHOD(Streaming)
+			{
+				std::string source ("abc = 'a long string'; /* comment\n */ x.5 + 1.5;\n");
+				auto expected = Plang::Lexer("", source).ReadAll();
+
+				std::istringstream iss (source);
+				Plang::Lexer lex ("", iss, 4); //tokens span several chunks
+				size_t i = 0;
+				for (auto& token : lex)
+				{
+					Assert::IsTrue(i < expected.size());
+					Assert::IsTrue(token.type == expected[i].type);
+					Assert::IsTrue(lex.Text(token) == expected[i].Text());
+					Assert::AreEqual(token.offset, expected[i].offset);
+					++i;
+				}
+				Assert::AreEqual(i, expected.size());
+
+				//the streamed module's line index matches the one built from the buffer
+				for (auto& token : expected)
+				{
+					auto line = Plang::Modules::Resolve(token.Locate());
+					auto streamed = Plang::Modules::Resolve({ lex.Module(), token.offset });
+					Assert::AreEqual(line.line, streamed.line);
+					Assert::AreEqual(line.column, streamed.column);
+				}
+			}
+
+			TEST_METHOD(Parallel)
+			{
+				std::string source;
+				for (int i = 0; i < 50; ++i)
+					source += "a.b = .5 + 'x; /* y' // z\n /* 'c \"d */ don't + \"e\\\" f\";\n";
+				auto expected = Plang::Lexer("", source).ReadAll();
+
+				for (size_t threads : { 2, 3, 7, 16 })
+				{
+					auto tokens = Plang::Lexer("", source).ReadAllParallel(threads, 1); //split points land inside strings and comments
+					Assert::AreEqual(tokens.size(), expected.size());
+					for (size_t i = 0; i < tokens.size(); ++i)
+					{
+						Assert::IsTrue(tokens[i].type == expected[i].type);
+						Assert::AreEqual(tokens[i].offset, expected[i].offset);
+						Assert::AreEqual(tokens[i].length, expected[i].length);
+					}
+				}
+			}
+
+			TEST_METHOD(Relex)
+			{
+				std::string source ("a = 1; b = 'c'; /* d */ e.f;\nx .5;\n");
+				Plang::Lexer lex ("", source);
+				auto tokens = lex.ReadAll();
+
+				struct
+				{
+					uint32_t offset;
+					uint32_t removed;
+					std::string inserted;
+				} edits[] = {
+					{ 4, 1, "23" },
+					{ 0, 0, "/*" }, //comments out everything up to the existing */
+					{ 0, 2, "" },
+					{ 11, 0, "\"" }, //unterminated string
+					{ 11, 1, "" },
+					{ 30, 1, "" }, //.5 becomes a number
+				};
+				for (auto& edit : edits)
+				{
+					source.replace(edit.offset, edit.removed, edit.inserted);
+					auto relexed = Plang::Lexer::Relex(lex.Module(), source, { edit.offset, edit.removed, (uint32_t)edit.inserted.length() }, tokens);
+					if (&edit == &edits[0])
+						Assert::IsTrue(relexed < 5);
+
+					auto expected = Plang::Lexer("", source).ReadAll();
+					Assert::AreEqual(tokens.size(), expected.size());
+					for (size_t i = 0; i < tokens.size(); ++i)
+					{
+						Assert::IsTrue(tokens[i].type == expected[i].type);
+						Assert::AreEqual(tokens[i].offset, expected[i].offset);
+						Assert::IsTrue(tokens[i].Text() == expected[i].Text());
+					}
+				}
+			}
+
+			//replacing the source of one module for each line, as the REPL does
+			TEST_METHOD(ReusedModule)
+			{
+				auto module = Plang::Modules::Register("#!");
+				auto count = Plang::Modules::Count();
+
+				std::string line;
+				Location last;
+				for (auto text : { "a + 1;", "\n  bb.c;", "d;" })
+				{
+					line = text;
+					auto source = std::make_shared<std::string>(line);
+					auto previous = (uint32_t)Plang::Modules::Source(module).length();
+					Plang::Modules::Edit(module, *source, { 0, previous, (uint32_t)source->length() }, source);
+
+					Plang::Lexer lex (module, 0, (uint32_t)source->length());
+					LexerToken token;
+					while (lex.NextToken(token))
+						last = token.Locate();
+					line.assign(100, 'x'); //the module keeps its own copy
+					Assert::IsTrue(Plang::Modules::Source(module) == text);
+				}
+				Assert::AreEqual(Plang::Modules::Count(), count, L"No modules are added");
+				Assert::AreEqual(Plang::Modules::Resolve(last).column, (size_t)2);
+
+				Plang::Modules::Edit(module, "", { 0, 2, 0 });
+				auto lines = Plang::Modules::LineStarts(module).size();
+				Plang::Modules::Edit(module, "\n\n", { 0, 0, 2 });
+				Assert::AreEqual(Plang::Modules::LineStarts(module).size(), lines + 2);
 			}
 		};
 	};
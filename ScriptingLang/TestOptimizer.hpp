@@ -0,0 +1,63 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Optimizer.hpp"
+#include "TestParser.hpp"
+
+#include <CppUnitTest.h>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Plang
+{
+	namespace Tests
+	{
+		TEST_CLASS(OPTIMIZER)
+		{
+		public:
+			//the optimized tree, in the notation of PARSER::Show
+			static std::string Optimize(const std::string& Source, const Plang::Construct& Scope, size_t* Folded = nullptr)
+			{
+				Plang::Lexer lex ("", Source);
+				Plang::Parser parser;
+				Assert::IsTrue(parser.Parse(lex));
+
+				Plang::Optimizer optimizer (Scope);
+				optimizer.Optimize(parser.root);
+				if (Folded != nullptr)
+					*Folded = optimizer.folded;
+				return PARSER::Show(parser.root);
+			}
+
+			TEST_METHOD(FoldConstants)
+			{
+				Plang::Construct scope;
+				size_t folded = 0;
+				Assert::IsTrue(Optimize("1 + 2 * 3;", scope, &folded) == "7");
+				Assert::AreEqual(folded, (size_t)2);
+				Assert::IsTrue(Optimize("3 + 5.0 * 4;", scope) == Instruction(InstructionType::Float, (TFloat)23).operator std::string());
+				Assert::IsTrue(Optimize("'a' + 'b';", scope) == "\"ab\"");
+				Assert::IsTrue(Optimize("-(2 - 5) < x;", scope) == "(< 3 x)", L"Prefix operators and parenthesized operands are folded");
+			}
+
+			TEST_METHOD(Unfoldable)
+			{
+				Plang::Construct scope;
+				Assert::IsTrue(Optimize("1 / 0;", scope) == "(/ 1 0)", L"Operations that fail at run time are left to fail");
+				Assert::IsTrue(Optimize("'a' - 'b';", scope) == "(- \"a\" \"b\")");
+				Assert::IsTrue(Optimize("x + 1 + 2;", scope) == "(+ (+ x 1) 2)");
+				Assert::IsTrue(Optimize("f = *; 2 * 3;", scope) == "(= f *); (* 2 3)", L"Operators used as values may be redefined");
+
+				scope.Set("+", Heap::New<Plang::Function>([](Plang::Construct&) { return Value(0); }));
+				Assert::IsTrue(Optimize("1 + 2;", scope) == "(+ 1 2)", L"Operators defined in scope are not built in");
+			}
+
+			TEST_METHOD(Simplify)
+			{
+				Plang::Construct scope;
+				Assert::IsTrue(Optimize("((x));;", scope) == "x");
+				Assert::IsTrue(Optimize("f((x));", scope) == "(f x)");
+				Assert::IsTrue(Optimize("f(x, (1 + 1));", scope) == "(f x 2)", L"Argument tuples are kept");
+			}
+		};
+	};
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Lexer.hpp"
+#include "Parser.hpp"
+
+#include <CppUnitTest.h>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Plang
+{
+	namespace Tests
+	{
+		TEST_CLASS(PARSER)
+		{
+		public:
+			//the first instruction in a tree that matches
+			template <class TPredicate>
+			static const Instruction* Find(const Instruction& Root, TPredicate Predicate)
+			{
+				std::vector<const Instruction*> stack { &Root };
+				while (!stack.empty())
+				{
+					auto instruction = stack.back();
+					stack.pop_back();
+					if (Predicate(*instruction))
+						return instruction;
+					if (auto list = std::get_if<TList>(&instruction->value))
+					{
+						for (auto& item : *list)
+							stack.push_back(&item);
+					}
+				}
+				return nullptr;
+			}
+
+			static const Instruction* FindInt(const Instruction& Root, TInt Value)
+			{
+				return Find(Root, [&](const Instruction& instruction)
+				{
+					return instruction.type == InstructionType::Int && std::get<TInt>(instruction.value) == Value;
+				});
+			}
+
+			//a tree in prefix notation: calls as (callee arguments...), missing operands as _, and other lists as Type{items...}
+			static std::string Show(const Instruction& Instruction)
+			{
+				auto list = std::get_if<TList>(&Instruction.value);
+				if (list == nullptr)
+					return Instruction.type == InstructionType::Unknown ? "_" : (std::string)Instruction;
+
+				std::string out;
+				if (Instruction.type == InstructionType::Call)
+				{
+					out = "(" + Show((*list)[0]);
+					for (auto& argument : std::get<TList>((*list)[1].value))
+						out += " " + Show(argument);
+					return out + ")";
+				}
+				for (auto& item : *list)
+					out += (out.empty() ? "" : (Instruction.type == InstructionType::Program ? "; " : " ")) + Show(item);
+				return Instruction.type == InstructionType::Program ? out : Instruction.TypeName() + "{" + out + "}";
+			}
+
+			static std::string Parse(const std::string& Source, bool ExpectErrors = false)
+			{
+				Plang::Lexer lex ("", Source);
+				Plang::Parser parser;
+				Assert::IsTrue(parser.Parse(lex) != ExpectErrors);
+				return Show(parser.root);
+			}
+
+			TEST_METHOD(Precedence)
+			{
+				Assert::IsTrue(Parse("1 + 2 * -x;") == "(+ 1 (* 2 (- x _)))");
+				Assert::IsTrue(Parse("a - b - c;") == "(- (- a b) c)", L"Left associative");
+				Assert::IsTrue(Parse("a = b = c;") == "(= a (= b c))", L"Right associative");
+				Assert::IsTrue(Parse("(a + b) * c;") == "(* (+ a b) c)");
+				Assert::IsTrue(Parse("x.y.z; [1, 'a'];") == "Accessor{x y z}; List{1 \"a\"}");
+			}
+
+			TEST_METHOD(OperatorDeclarations)
+			{
+				Assert::IsTrue(Parse("#operator ** infix right 2 a ** b ** c * d;") == "(* (** a (** b c)) d)");
+				Assert::IsTrue(Parse("#operator !! postfix 1 a !! + b;") == "(+ (!! _ a) b)", L"Postfix operators have no left operand");
+				Assert::IsTrue(Parse("#operator ?? prefix 2 x = ?? a + b;") == "(= x (+ (?? a _) b))");
+				Assert::IsTrue(Parse("a ** b;", true) != "(** a b)", L"Declarations only apply to their module");
+				Parse("#operator ** infix up 2", true);
+			}
+
+			TEST_METHOD(ErrorRecovery)
+			{
+				auto errorType = Parser::ReportType(ParserError::InvalidOperator);
+				auto level = ReportLog::GetType(errorType).level;
+				auto reported = ReportLog::Reports(level).size();
+
+				Plang::Lexer lex ("", "a = ; b = 1; c = (; d = 2;");
+				Plang::Parser parser;
+				Assert::IsTrue(!parser.Parse(lex));
+				Assert::IsTrue(parser.errors.size() >= 2);
+				Assert::IsTrue(parser.errors[0].type == errorType);
+				Assert::AreEqual(ReportLog::Reports(level).size(), reported + parser.errors.size(), L"Errors are also added to the report log");
+				Assert::IsTrue(Show(parser.root).find("(= b 1)") != std::string::npos, L"Parsing continues after the statement with the error");
+			}
+
+			TEST_METHOD(DeferredBodies)
+			{
+				std::string source ("f = (a) { a + 1; };");
+				Plang::Lexer lex ("", source);
+				Plang::Parser parser;
+				parser.deferBodies = true;
+				Assert::IsTrue(parser.Parse(lex));
+
+				auto deferred = Find(parser.root, [](const Instruction& instruction) { return instruction.type == InstructionType::Deferred; });
+				Assert::IsTrue(deferred != nullptr && FindInt(parser.root, 1) == nullptr, L"The body is not parsed");
+
+				std::shared_ptr<const void> owner;
+				auto body = Parser::ParseDeferred(*deferred, owner);
+				Assert::IsTrue(body.type == InstructionType::Block && owner != nullptr);
+				Assert::IsTrue(FindInt(body, 1) != nullptr);
+				std::shared_ptr<const void> again;
+				Assert::IsTrue(std::get<TList>(Parser::ParseDeferred(*deferred, again).value).begin() == std::get<TList>(body.value).begin(), L"Each body is only parsed once");
+
+				//editing the module drops the parsed bodies, and those deferred before the edit can no longer be parsed
+				source.replace(14, 1, "2");
+				Modules::Edit(lex.Module(), source, { 14, 1, 1 });
+				bool threw = false;
+				try { Parser::ParseDeferred(*deferred, again); }
+				catch (const std::string&) { threw = true; }
+				Assert::IsTrue(threw, L"Out of date bodies are not parsed");
+				Assert::IsTrue(FindInt(body, 1) != nullptr, L"Parsed bodies are kept by their owner");
+
+				Plang::Lexer relex (lex.Module(), 0, (uint32_t)source.length());
+				Plang::Parser reparser;
+				reparser.deferBodies = true;
+				Assert::IsTrue(reparser.Parse(relex));
+				auto edited = Parser::ParseDeferred(*Find(reparser.root, [](const Instruction& instruction) { return instruction.type == InstructionType::Deferred; }), again);
+				Assert::IsTrue(FindInt(edited, 2) != nullptr && FindInt(edited, 1) == nullptr);
+			}
+
+			TEST_METHOD(DeferredErrors)
+			{
+				Plang::Lexer lex ("", "f = (a) { a + ; };");
+				Plang::Parser parser;
+				parser.deferBodies = true;
+				Assert::IsTrue(parser.Parse(lex), L"Errors in deferred bodies are found when they are parsed");
+
+				auto deferred = Find(parser.root, [](const Instruction& instruction) { return instruction.type == InstructionType::Deferred; });
+				std::shared_ptr<const void> owner;
+				bool threw = false;
+				try { Parser::ParseDeferred(*deferred, owner); }
+				catch (const std::string&) { threw = true; }
+				Assert::IsTrue(threw);
+			}
+		};
+	};
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Lexer.hpp"
+#include "Parser.hpp"
+#include "ProgramCache.hpp"
+
+#include <CppUnitTest.h>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Plang
+{
+	namespace Tests
+	{
+		TEST_CLASS(PROGRAMCACHE)
+		{
+		public:
+			static constexpr const char* Path = "TestProgramCache.plangc";
+			static constexpr const char* Source = "a = f(1, 2.5, 'b');\n-x.y;\n(q) { q + 1; };\n";
+
+			//visit every instruction of a tree
+			template <class TVisit>
+			static void Walk(const Instruction& Root, TVisit Visit)
+			{
+				std::vector<const Instruction*> stack { &Root };
+				while (!stack.empty())
+				{
+					auto instruction = stack.back();
+					stack.pop_back();
+					Visit(*instruction);
+					if (auto list = std::get_if<TList>(&instruction->value))
+					{
+						for (auto& item : *list)
+							stack.push_back(&item);
+					}
+				}
+			}
+
+			static std::vector<std::string> Flatten(const Instruction& Root)
+			{
+				std::vector<std::string> flat;
+				Walk(Root, [&](const Instruction& instruction)
+				{
+					flat.push_back(std::to_string((int)instruction.type) + " " + std::to_string(instruction.location.offset) + " " +
+						(instruction.symbol != NoSymbol ? std::string(Symbols::Name(instruction.symbol)) : "") +
+						(std::holds_alternative<TList>(instruction.value) ? "" : (std::string)instruction));
+				});
+				return flat;
+			}
+
+			TEST_METHOD(RoundTrip)
+			{
+				Plang::Lexer lex ("", Source);
+				Plang::Parser parser;
+				Assert::IsTrue(parser.Parse(lex));
+				Assert::IsTrue(ProgramCache::Save(Path, Source, lex.Module(), parser.root));
+
+				ProgramCache::Program program;
+				Assert::IsTrue(ProgramCache::Load(Path, "cached", Source, program));
+				Assert::IsTrue(Flatten(program.root) == Flatten(parser.root));
+				Assert::AreEqual(Modules::Resolve(std::get<TList>(program.root.value).back().location).line, (size_t)3, L"The line index is cached");
+
+				Assert::IsTrue(!ProgramCache::Load(Path, "cached", "a = f(1, 2.5, 'c');\n-x.y;\n(q) { q + 1; };\n", program), L"Stale caches are ignored");
+				std::remove(Path);
+			}
+
+			TEST_METHOD(UncalledErrors)
+			{
+				const char* sourcePath = "TestProgramCache.plang";
+				{
+					std::ofstream fout (sourcePath, std::ios::binary | std::ios::trunc);
+					fout << "f = (a) { a + ; };\n";
+				}
+				std::remove(ProgramCache::PathFor(sourcePath).c_str());
+
+				std::vector<Report> errors;
+				ProgramCache::LoadOrParse(sourcePath, errors);
+				Assert::IsTrue(!errors.empty(), L"Bodies are parsed before a program is cached");
+				Assert::IsTrue(!std::ifstream(ProgramCache::PathFor(sourcePath)).good(), L"Programs with errors are not cached");
+				std::remove(sourcePath);
+			}
+
+			TEST_METHOD(Lazy)
+			{
+				const char* sourcePath = "TestProgramCache.plang";
+				{
+					std::ofstream fout (sourcePath, std::ios::binary | std::ios::trunc);
+					fout << "((a) { 1 + 2; })((b) { b + ; });\n";
+				}
+				std::remove(ProgramCache::PathFor(sourcePath).c_str());
+
+				std::vector<Report> errors;
+				auto program = ProgramCache::LoadOrParse(sourcePath, errors, true);
+				Assert::IsTrue(errors.empty(), L"Bodies are parsed when called");
+				size_t deferred = 0;
+				Walk(program.root, [&](const Instruction& instruction) { deferred += (instruction.type == InstructionType::Deferred); });
+				Assert::AreEqual(deferred, (size_t)2);
+				Assert::IsTrue(!std::ifstream(ProgramCache::PathFor(sourcePath)).good(), L"Lazily parsed programs are not cached");
+
+				Plang::Script script (program.root, program.owner);
+				Assert::AreEqual(script.Evaluate(Heap::New<Plang::Construct>()).AsInt(), (TInt)3);
+				std::remove(sourcePath);
+			}
+
+			TEST_METHOD(Corrupted)
+			{
+				Plang::Lexer lex ("", Source);
+				Plang::Parser parser;
+				Assert::IsTrue(parser.Parse(lex));
+				Assert::IsTrue(ProgramCache::Save(Path, Source, lex.Module(), parser.root));
+
+				std::string image;
+				{
+					std::ifstream fin (Path, std::ios::binary);
+					image.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+				}
+
+				//every byte changed in turn. Files that still load must only refer to valid symbols, and a module is only registered for those
+				for (size_t i = 0; i < image.size(); ++i)
+				{
+					auto corrupted = image;
+					corrupted[i] ^= 0x5a;
+					{
+						std::ofstream fout (Path, std::ios::binary | std::ios::trunc);
+						fout.write(corrupted.data(), corrupted.size());
+					}
+
+					auto modules = Modules::Count();
+					ProgramCache::Program program;
+					if (!ProgramCache::Load(Path, "corrupted", Source, program))
+					{
+						Assert::AreEqual(Modules::Count(), modules, L"Invalid caches do not register a module");
+						continue;
+					}
+					Walk(program.root, [](const Instruction& instruction)
+					{
+						Assert::IsTrue(instruction.symbol == NoSymbol || instruction.symbol < Symbols::Count());
+					});
+				}
+				std::remove(Path);
+			}
+		};
+	};
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Construct.hpp"
+#include <thread>
+
+#include <CppUnitTest.h>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Plang
+{
+	namespace Tests
+	{
+		//Constructs handed between threads. Only run when built with PLANG_ATOMIC_REFERENCES (and best run with a thread sanitizer)
+		TEST_CLASS(THREADS)
+		{
+		public:
+			static constexpr size_t ThreadCount = 4;
+
+			template <class TFunction>
+			static void RunThreads(TFunction Function)
+			{
+				std::vector<std::thread> threads;
+				for (size_t t = 0; t < ThreadCount; ++t)
+					threads.emplace_back(Function, t);
+				for (auto& thread : threads)
+					thread.join();
+			}
+
+			TEST_METHOD(SharedReferences)
+			{
+#ifdef PLANG_ATOMIC_REFERENCES
+				auto shared = Heap::New<Plang::Construct>();
+				shared->Set("x", Heap::New<Plang::String>("s"));
+				RunThreads([&](size_t)
+				{
+					for (int i = 0; i < 20000; ++i)
+					{
+						AnyRef copy (shared);
+						Value x = copy->Get("x");
+						auto mine = Heap::New<Plang::List>();
+						mine->Add(copy);
+						mine->Add(x);
+					}
+				});
+				Assert::AreEqual(shared->References(), (uint32_t)1);
+#endif
+			}
+
+			TEST_METHOD(SharedShapes)
+			{
+#ifdef PLANG_ATOMIC_REFERENCES
+				//every thread adds the same properties in the same order, so they share (and release) the same shapes
+				const char* names[] = { "a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k", "l" };
+				RunThreads([&](size_t thread)
+				{
+					for (int i = 0; i < 2000; ++i)
+					{
+						auto construct = Heap::New<Plang::Construct>();
+						for (auto name : names)
+							construct->Set(name, (TInt)thread);
+						construct->Remove(names[i % 12]);
+						for (size_t n = 0; n < 12; ++n)
+						{
+							Assert::IsTrue(construct->Has(names[n]) == (n != (size_t)i % 12));
+							Assert::IsTrue(n == (size_t)i % 12 || construct->Get(names[n]).AsInt() == (TInt)thread);
+						}
+					}
+				});
+#endif
+			}
+		};
+	};
+};
@@ -0,0 +1,101 @@
+#include "pch.hpp"
+#include "Value.hpp"
+#include "Construct.hpp"
+
+using namespace Plang;
+
+Value Plang::Undefined;
+
+ConstructType Value::Type() const
+{
+    switch (tag)
+    {
+    case Tag::Int:
+        return ConstructType::Int;
+    case Tag::Float:
+        return ConstructType::Float;
+    case Tag::Reference:
+        return ref->Type();
+    default:
+        return ConstructType::Invalid;
+    }
+}
+
+std::string Value::ToString() const
+{
+    switch (tag)
+    {
+    case Tag::Int:
+        return std::to_string(i);
+    case Tag::Float:
+        return std::to_string(f);
+    case Tag::Reference:
+        return ref->ToString();
+    default:
+        return "undefined";
+    }
+}
+
+Value Value::Get(const std::string& Name) const
+{
+    return Properties().Get(Name);
+}
+
+const Construct& Value::Properties() const
+{
+    switch (tag)
+    {
+    case Tag::Int:
+        return *Int::Prototype();
+    case Tag::Float:
+        return *Float::Prototype();
+    case Tag::Reference:
+        return *ref;
+    default:
+        throw std::string("Undefined has no properties");
+    }
+}
+
+AnyRef Value::Box() const
+{
+    switch (tag)
+    {
+    case Tag::Int:
+        return Heap::New<Int>(i);
+    case Tag::Float:
+        return Heap::New<Float>(f);
+    case Tag::Reference:
+        return ref;
+    default:
+        throw std::string("Undefined cannot be boxed");
+    }
+}
+
+bool Value::operator == (const Value& Other) const
+{
+    if (tag != Other.tag)
+        return false;
+
+    switch (tag)
+    {
+    case Tag::Int:
+        return i == Other.i;
+    case Tag::Float:
+        return f == Other.f;
+    case Tag::Reference:
+        return ref == Other.ref;
+    default:
+        return true;
+    }
+}
+
+std::ostream& Plang::operator << (std::ostream& Stream, const Value& Value)
+{
+    if (Value.IsUndefined())
+        Stream << "Undefined";
+    else if (Value.IsReference())
+        Stream << *Value.AsReference();
+    else
+        Stream << TypeToString(Value.Type()) << "{" << Value.ToString() << "}";
+    return Stream;
+}
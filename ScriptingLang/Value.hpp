@@ -0,0 +1,116 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Instruction.hpp"
+#include "Reference.hpp"
+
+namespace Plang
+{
+    class Construct;
+    using AnyRef = Reference<Construct>;
+
+    enum class ConstructType;
+
+    //A runtime value: undefined, an int or float stored inline, or a reference to a construct.
+    //Numbers are not boxed to look up their properties (which are found in their type's prototype), so using them does not allocate
+    class Value
+    {
+    public:
+        enum class Tag : uint8_t
+        {
+            Undefined,
+            Int,
+            Float,
+            Reference,
+        };
+
+        Value() : i(0) { }
+        Value(std::nullptr_t) : Value() { }
+        Value(TInt Int) : tag(Tag::Int), i(Int) { }
+        Value(int Int) : Value((TInt)Int) { }
+        Value(TFloat Float) : tag(Tag::Float), f(Float) { }
+        Value(const AnyRef& Ref) : Value() { if (Ref != nullptr) { new (&ref) AnyRef(Ref); tag = Tag::Reference; } }
+        Value(AnyRef&& Ref) : Value() { if (Ref != nullptr) { new (&ref) AnyRef(std::move(Ref)); tag = Tag::Reference; } }
+        template <class T, typename = std::enable_if_t<!std::is_same<T, Construct>::value>>
+        Value(const Reference<T>& Ref) : Value(AnyRef(Ref)) { }
+
+        Value(const Value& Other) : tag(Other.tag)
+        {
+            if (tag == Tag::Reference)
+                new (&ref) AnyRef(Other.ref);
+            else
+                i = Other.i; //copies the float too
+        }
+        Value(Value&& Other) noexcept : tag(Other.tag)
+        {
+            if (tag == Tag::Reference)
+            {
+                new (&ref) AnyRef(std::move(Other.ref));
+                Other.Reset();
+            }
+            else
+                i = Other.i;
+        }
+        ~Value() { Reset(); }
+
+        //copied before this is changed, as Other may be owned by the construct this refers to
+        inline Value& operator = (const Value& Other) { return (*this = Value(Other)); }
+        inline Value& operator = (Value&& Other) noexcept
+        {
+            if (&Other != this)
+            {
+                Value moved(std::move(Other)); //(see above)
+                Reset();
+                new (this) Value(std::move(moved));
+            }
+            return *this;
+        }
+
+        inline Tag GetTag() const { return tag; }
+        inline bool IsUndefined() const { return tag == Tag::Undefined; }
+        inline bool IsInt() const { return tag == Tag::Int; }
+        inline bool IsFloat() const { return tag == Tag::Float; }
+        inline bool IsReference() const { return tag == Tag::Reference; }
+
+        inline TInt AsInt() const { assert(IsInt()); return i; }
+        inline TFloat AsFloat() const { assert(IsFloat()); return f; }
+        inline const AnyRef& AsReference() const { assert(IsReference()); return ref; }
+        template <class T>
+        inline T& As() const { assert(IsReference()); return static_cast<T&>(*ref); }
+        template <class T>
+        T& Modify(); //As, but replaces a frozen construct with a copy first (see Construct::Freeze). Defined in Construct.hpp
+
+        ConstructType Type() const; //Invalid if undefined
+        std::string ToString() const;
+
+        //Look up a property (searching prototypes). Must not be undefined
+        Value Get(const std::string& Name) const;
+        const Construct& Properties() const; //the construct searched for properties: the referent, or the shared prototype of a number's type
+        AnyRef Box() const; //a construct holding this value (a new Int or Float for numbers). Must not be undefined
+
+        //References are equal if they refer to the same construct
+        bool operator == (const Value& Other) const;
+        inline bool operator != (const Value& Other) const { return !(*this == Other); }
+
+    protected:
+        Tag tag = Tag::Undefined;
+        union
+        {
+            TInt i;
+            TFloat f;
+            AnyRef ref;
+        };
+
+        inline void Reset()
+        {
+            if (tag == Tag::Reference)
+                ref.~AnyRef();
+            tag = Tag::Undefined;
+            i = 0;
+        }
+    };
+
+    extern Value Undefined;
+
+    std::ostream& operator << (std::ostream& Stream, const Value& Value);
+};
@@ -4,35 +4,40 @@
 #include "Parser.hpp"
 #include "Instruction.hpp"
 #include "Construct.hpp"
+#include "ProgramCache.hpp"
+#include "Optimizer.hpp"
+#include "Bytecode.hpp"
 
 int main(int ac, const char* av[])
 {
 	Plang::Parser parser;
-	Plang::AnyRef scope(new Plang::Construct);
+	auto scope(Plang::Heap::New<Plang::Construct>());
 
-    scope->Set("+", std::make_shared<Plang::Function>(Plang::Signature("(a,b)"), [](const Plang::Construct& scope)
+    scope->Set("+", Plang::Heap::New<Plang::Function>(Plang::Signature("(a,b)"), [](const Plang::Construct& scope)
     {
         std::cout << "hoopla!\n";
-        return std::make_shared<Plang::Int>(5);
+        return Plang::Value(5);
     }));
 
-    scope->Set("-", std::make_shared<Plang::Function>(Plang::Signature({ { "a" }, { "b" } }), [](const Plang::Construct& scope)
+    scope->Set("-", Plang::Heap::New<Plang::Function>(Plang::Signature({ { "a" }, { "b" } }), [](const Plang::Construct& scope)
     {
         std::cout << "xyz!\n";
-        return std::make_shared<Plang::Int>(5);
+        return Plang::Value(5);
     }));
 
     using namespace std::literals::string_literals;
-    auto a(std::make_shared<Plang::Construct>());
-    a->Set("b", std::make_shared<Plang::Int>(10));
+    auto a(Plang::Heap::New<Plang::Construct>());
+    a->Set("b", 10);
     scope->Set("a", a);
 
 	if (ac < 2)
 	{
 		std::cout << "Interactive mode\n";
 
+		//every line is lexed as the new source of one module, rather than registering a module per line.
+		//The module owns a copy of the line, since the locations in a line's tree refer to its text
+		auto replModule = Plang::Modules::Register("#!");
 		std::string line;
-		std::istringstream iss;
 		while (std::cin.good())
 		{
 			std::cout << "<< ";
@@ -59,17 +64,22 @@ int main(int ac, const char* av[])
 				continue;
 			}
 
-			iss.str(line);
-			iss.clear();
-
 			try
 			{
-				Plang::Lexer lex("#!", iss);
+				auto source = std::make_shared<std::string>(line);
+				auto previous = (uint32_t)Plang::Modules::Source(replModule).length();
+				Plang::Modules::Edit(replModule, *source, { 0, previous, (uint32_t)source->length() }, source);
+				Plang::Lexer lex(replModule, 0, (uint32_t)source->length());
                 Plang::Parser parser;
-                parser.Parse(lex.tokens);
+                if (!parser.Parse(lex))
+                {
+                    for (auto& error : parser.errors)
+                        std::cout << "! Error: " << Plang::ReportLog::Format(error) << " @ " << error.location << "\n";
+                    continue;
+                }
 
                 std::cout << parser.root << "\n---\n";
-                auto s = Plang::Script(parser.root);
+                auto s = Plang::Script(parser.root, parser.arena);
                 auto x = s.Evaluate(scope);
                 std::cout << ">> " << x << std::endl;
 			}
@@ -78,56 +88,91 @@ int main(int ac, const char* av[])
 				std::cout << "! Error: " << x.what() << "\n";
 				continue;
 			}
+			catch (const std::string& x)
+			{
+				std::cout << "! Error: " << x << "\n";
+				continue;
+			}
 		}
 
-		// std::cout << av[0] << " <script>";
-		// return 1;
+		return 0;
 	}
 
-	/*try
+	//options: --no-optimize, --dump-optimizations (print what the optimizer changed), --tree-walk (evaluate without compiling to bytecode),
+	//--cache-stats (print how often property lookups hit their caches), --lazy (parse expression bodies when they are first called, without updating the cache)
+	bool optimize = true, dumpOptimizations = false, cacheStats = false, lazy = false;
+	int arg = 1;
+	for (; arg < ac && StringOps::StartsWith(av[arg], "--"); ++arg)
 	{
-		if (StringOps::StartsWith(av[1], "-e") || StringOps::StartsWith(av[1], "--eval"))
-		{
-			const char* sp = av[2];
-			if (strlen(av[1]) > 2)
-				sp = av[1] + 2;
-
-			std::istringstream iss(sp);
-
-			lex = Plang::Lexer("#!", iss);
-		}
-
+		if (strcmp(av[arg], "--no-optimize") == 0)
+			optimize = false;
+		else if (strcmp(av[arg], "--dump-optimizations") == 0)
+			dumpOptimizations = true;
+		else if (strcmp(av[arg], "--tree-walk") == 0)
+			Plang::Script::evaluationMode = Plang::Script::EvaluationMode::Tree;
+		else if (strcmp(av[arg], "--cache-stats") == 0)
+			cacheStats = true;
+		else if (strcmp(av[arg], "--lazy") == 0)
+			lazy = true;
 		else
 		{
-			std::ifstream fin;
-			fin.open(av[1], std::ios::in);
-			if (!fin.is_open())
-			{
-				std::cerr << "Error opening " << av[1];
-				return 2;
-			}
-
-			lex = Plang::Lexer(av[1], fin);
-			fin.close();
+			std::cerr << "Unknown option " << av[arg] << "\n";
+			return 2;
 		}
+	}
+	if (arg >= ac)
+	{
+		std::cerr << av[0] << " [--no-optimize] [--dump-optimizations] [--tree-walk] [--cache-stats] [--lazy] <script>\n";
+		return 2;
+	}
 
-		//std::ofstream fout;
-		//fout.open("tests/out.lex", std::ios::out);
-		//fout << lex;
-		//fout.close();
+	//run a script, using its compiled cache (script.plangc) if it is up to date
+	std::vector<Plang::Report> errors;
+	auto program = Plang::ProgramCache::LoadOrParse(av[arg], errors, lazy);
+	if (program.root.type == Plang::InstructionType::Unknown)
+	{
+		std::cerr << "Error opening " << av[arg] << "\n";
+		return 2;
+	}
+	if (!errors.empty())
+	{
+		for (auto& error : errors)
+			std::cout << "! Error: " << Plang::ReportLog::Format(error) << " @ " << error.location << "\n";
+		return 1;
+	}
 
+	//the script keeps the optimizer's arena (which holds folded strings) along with the program
+	auto owner = program.owner;
+	if (optimize)
+	{
+		Plang::Optimizer optimizer(*scope);
+		if (dumpOptimizations)
+			optimizer.dump = &std::cout;
+		optimizer.Optimize(program.root);
+		owner = std::make_shared<std::pair<std::shared_ptr<const void>, std::shared_ptr<const void>>>(program.owner, optimizer.arena);
+	}
 
-		parser = Plang::Parser(lex.tokens);
-		//fout.open("tests/out.parse", std::ios::out);
-		//std::cout << parser.syntaxTree << "\n";
-		//fout.close();
-		Plang::Script(parser.syntaxTree.root).Evaluate(global);
+	Plang::Script script(program.root, owner);
+	try
+	{
+		script.Evaluate(scope);
 	}
-	catch (const Plang::EParser& Expt)
+	catch (const std::exception& x)
 	{
-		std::cout << "! Parser Error: " << Expt << "\n";
+		std::cout << "! Error: " << x.what() << "\n";
 		return 1;
-	}*/
+	}
+	catch (const std::string& x)
+	{
+		std::cout << "! Error: " << x << "\n";
+		return 1;
+	}
+
+	if (cacheStats && script.code != nullptr)
+	{
+		auto stats = script.code->CacheStats();
+		std::cout << "Property caches: " << stats.hits << " hits, " << stats.misses << " misses\n";
+	}
 
 	return 0;
 }
@@ -1,10 +1,12 @@
 #define _SCL_SECURE_NO_WARNINGS
 
 #include <vector>
+#include <array>
 #include <queue>
 #include <stack>
 #include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <set>
 #include <string>
 #include <locale>
@@ -26,6 +28,13 @@
 #include <new>
 #include <memory>
 #include <cstdint>
+#include <limits>
+#include <cstring>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <cerrno>
+#include <thread>
 
 #include "StringOps.hpp"
 